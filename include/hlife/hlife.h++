@@ -14,20 +14,88 @@
 #ifndef HLIFE_HPP
 #define HLIFE_HPP
 
+#include <hlife/stats.h++>
+#include <hlife/task_pool.h++>
+
+#include <algorithm>
 #include <array>
-#include <functional>
-#include <unordered_set>
+#include <atomic>
+#include <mutex>
+#include <thread>
 #include <tuple>
 #include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
 #include <utility>
+#include <vector>
+#include <cmath>
 #include <cstddef>
+#include <cstdint>
 #include <cassert>
 
 namespace hlife {
-    // Cellspace is the set of all possible cells.
-    struct cellspace;
-    // A single cell (can be a macro-cell or a leaf)
+    // An outer-totalistic rule on the Moore neighbourhood. A dead cell with n
+    // live neighbours is born if bit n of Birth is set, and a live one
+    // survives if bit n of Survival is set. Rules are applied to many cells
+    // at once, given their neighbour counts as bit planes; the loops over
+    // the counts fold away for each rule.
+    template <unsigned Birth, unsigned Survival>
+    struct rule {
+    public:
+        static_assert(!(Birth & 1), "cells born without neighbours would fill the empty space");
+        static_assert(Birth < 0x200 && Survival < 0x200, "cells have no more than eight neighbours");
+
+        // The next state of each cell given whether it is alive and the bit
+        // planes of its neighbour count. The fourth plane is only read by
+        // rules that tell eight neighbours from none.
+        static std::uint32_t next(std::uint32_t alive, std::uint32_t s0, std::uint32_t s1, std::uint32_t s2, std::uint32_t s3) {
+            return (alive & any_of(Survival, s0, s1, s2, s3)) | (~alive & any_of(Birth, s0, s1, s2, s3));
+        }
+
+        // The rule in B/S notation, such as B3/S23.
+        static std::string name() {
+            std::string name = "B";
+            for(unsigned n = 0; n <= 8; ++n) if(Birth >> n & 1) name += static_cast<char>('0' + n);
+            name += "/S";
+            for(unsigned n = 0; n <= 8; ++n) if(Survival >> n & 1) name += static_cast<char>('0' + n);
+            return name;
+        }
+
+    private:
+        // Whether counts of zero and eight are told apart by the rule. If not,
+        // a three-bit count that wraps at eight is enough.
+        static constexpr bool counts_eight = ((Birth ^ Birth >> 8) | (Survival ^ Survival >> 8)) & 1;
+
+        // The cells whose count is one of those in the mask.
+        static std::uint32_t any_of(unsigned mask, std::uint32_t s0, std::uint32_t s1, std::uint32_t s2, std::uint32_t s3) {
+            std::uint32_t result = 0;
+            for(unsigned n = 0; n < (counts_eight? 9u : 8u); ++n) {
+                if(!(mask >> n & 1)) continue;
+                std::uint32_t match = (n & 1? s0 : ~s0) & (n & 2? s1 : ~s1) & (n & 4? s2 : ~s2);
+                if(counts_eight) match &= n & 8? s3 : ~s3;
+                result |= match;
+            }
+            return result;
+        }
+    };
+
+    // Conway's Game of Life, B3/S23.
+    using life = rule<1u << 3, 1u << 2 | 1u << 3>;
+
+    // Cellspace is the set of all possible cells, evolving under a rule.
+    template <typename Rule>
+    struct basic_cellspace;
+    using cellspace = basic_cellspace<life>;
+    // A world is a square region of a cellspace that can be evolved.
+    template <typename Rule>
+    struct basic_world;
+    using world = basic_world<life>;
+    // A single cell (can be a macro-cell or a leaf tile)
     union cell;
+    // Pattern file loaders and savers
+    struct patterns;
     using cell_ptr = cell const*;
     using cell_ref = cell const&;
 
@@ -48,15 +116,32 @@ namespace hlife {
         struct key {
         private:
             key() = default;
-            friend struct cellspace;
+            template <typename Rule>
+            friend struct basic_cellspace;
         };
 
-        // Except for the two leaves, ctors should only be used by cellspace to
-        // generate cells uniquely and as needed. The passkey idiom is used to
-        // enforce that.
-        cell(key const&, bool status) : alive(status) {}
+        // Ctors should only be used by cellspace to generate cells uniquely
+        // and as needed. The passkey idiom is used to enforce that.
+        cell(key const&, std::uint64_t bits) : tile(bits) {}
         cell(key const&, cell_ref nw, cell_ref ne, cell_ref sw, cell_ref se)
-        : q{ &nw, &ne, &sw, &se, nullptr } {}
+        : q(nw, ne, sw, se) {}
+
+        // The number of live cells in this cell, which has sides 2^level.
+        // Like the future, the count is evaluated lazily and memoised on
+        // macro-cells. Counts that do not fit in 64 bits saturate.
+        std::uint64_t population(int level) const {
+            if(level == 3) return static_cast<std::uint64_t>(__builtin_popcountll(tile));
+            std::uint64_t count = q.population.load(std::memory_order_relaxed);
+            if(count != unknown_population) return count;
+            count = 0;
+            cell_ptr parts[] = { q.nw, q.ne, q.sw, q.se };
+            for(cell_ptr c : parts) {
+                std::uint64_t n = c->population(level-1);
+                count = n < max_population - count? count + n : max_population;
+            }
+            q.population.store(count, std::memory_order_relaxed);
+            return count;
+        }
 
         // Tests if a point is in a cell's light cone The only properties of
         // the cell that are needed are the extrinsic ones: its level (aka
@@ -64,9 +149,13 @@ namespace hlife {
         // member, and should probably be, but since it uses no intrinsic
         // properties, we can avoid the unnecessary evaluation of some cells.
         static bool in_light_cone(int level, point center, point p) {
-            // Leaves have a degenerate light cone, so the point has to be at
-            // the leaf's position to be in the cone.
-            if(level == 0) return center == p;
+            // Leaf tiles cannot be evaluated, so the point has to be one of
+            // the tile's 8x8 cells, at the tile's time, to be in the cone.
+            if(level == 3) {
+                return p.t == center.t
+                    && p.x >= center.x - 4 && p.x < center.x + 4
+                    && p.y >= center.y - 4 && p.y < center.y + 4;
+            }
 
             // If the point is in the past it's not in the light cone.
             if(p.t < center.t) return false;
@@ -76,20 +165,23 @@ namespace hlife {
 
             // If the point is in the future and lies within this cell's future
             // space (the central pseudo-quadrant), we search the future cell.
+            // The future cell is centered at the same spatial coordinates, but
+            // 2^(level-2) generations later.
             if(p.t > center.t
-               && p.x >= (center.x - offset)
-               && p.x <  (center.x + offset)
-               && p.y >= (center.y - offset)
-               && p.y <  (center.y + offset)) {
-                return in_light_cone(level-1, qcenter, p);
+               && p.x >= (center.x - center_offset)
+               && p.x <  (center.x + center_offset)
+               && p.y >= (center.y - center_offset)
+               && p.y <  (center.y + center_offset)) {
+                point fcenter { center.x, center.y, center.t + center_offset };
+                return in_light_cone(level-1, fcenter, p);
             }
 
             // Otherwise we need to search for the point in a specific quadrant
             // The quadrant's center is at the same time, but at different
             // spatial coordinates that differ from this cell's center by a
             // quarter the side of this cell in both axes.
-            bool north = p.x < center.x;
-            bool west  = p.y < center.y;
+            bool west  = p.x < center.x;
+            bool north = p.y < center.y;
             point qcenter {
                 center.x + (west?  -1 : 1) * center_offset,
                 center.y + (north? -1 : 1) * center_offset,
@@ -105,42 +197,32 @@ namespace hlife {
         // This should be the only way to obtain macro-cells.
         // We simply assume that all cells exist in cellspace
         // and none needs to be created through the ctors.
-        static cell_ref get_cell(cellspace& space, cell_ref nw, cell_ref ne, cell_ref sw, cell_ref se);
-
-        // Live and dead leaf cells from the cellspace.
-        static cell_ref live(cellspace& space);
-        static cell_ref dead(cellspace& space);
+        template <typename Rule>
+        static cell_ref get_cell(basic_cellspace<Rule>& space, cell_ref nw, cell_ref ne, cell_ref sw, cell_ref se);
+        // Retrieves a matching leaf tile from the cellspace.
+        template <typename Rule>
+        static cell_ref get_tile(basic_cellspace<Rule>& space, std::uint64_t bits);
 
         // Evaluates this cell, effectively computing the future of this cell's
         // quadrants. This result is a cell one size smaller as the rest of the
         // cell depends on neighboring cells.
-        cell_ref result(cellspace& space, int level) const {
-            assert(level > 1); // 1-cells cannot be evaluated
+        template <typename Rule>
+        cell_ref result(basic_cellspace<Rule>& space, int level) const {
+            assert(level > 3); // tiles cannot be evaluated
 
             // Early exit for memoised results.
-            if(q.future) return *q.future;
-
-            // Recursive evaluation bottoms out at 2-cells since 1-cells cannot
-            // be evaluated.
-            if(level == 2) {
-                // 2-cells are evaluated normally by counting live neighbours.
-                int nnw = *q.nw->q.nw + *q.nw->q.ne + *q.ne->q.nw
-                        + *q.nw->q.sw               + *q.ne->q.sw
-                        + *q.sw->q.nw + *q.sw->q.ne + *q.se->q.nw;
-                int nne = *q.nw->q.ne + *q.ne->q.nw + *q.ne->q.ne
-                        + *q.nw->q.se               + *q.ne->q.se
-                        + *q.sw->q.ne + *q.se->q.nw + *q.se->q.ne;
-                int nsw = *q.nw->q.sw + *q.nw->q.se + *q.ne->q.sw
-                        + *q.sw->q.nw               + *q.se->q.nw
-                        + *q.sw->q.sw + *q.sw->q.se + *q.se->q.sw;
-                int nse = *q.nw->q.se + *q.ne->q.sw + *q.ne->q.se
-                        + *q.sw->q.ne               + *q.se->q.ne
-                        + *q.sw->q.se + *q.se->q.sw + *q.se->q.se;
-                q.future = &get_cell(space,
-                        future_leaf(space, nnw, *q.nw->q.se),
-                        future_leaf(space, nne, *q.ne->q.sw),
-                        future_leaf(space, nsw, *q.sw->q.ne),
-                        future_leaf(space, nse, *q.se->q.nw));
+            if(cell_ptr future = q.future.load(std::memory_order_acquire)) {
+                space.counters.count_result(level, true);
+                return *future;
+            }
+            space.counters.count_result(level, false);
+
+            // Recursive evaluation bottoms out at 4-cells, whose four quadrants
+            // are tiles.
+            if(level == 4) {
+                // 4-cells are evaluated with a bit-parallel kernel over the
+                // 16x16 block.
+                return publish(get_tile(space, evolve<Rule>(q.nw->tile, q.ne->tile, q.sw->tile, q.se->tile, 4)));
             } else {
                 // n-cells are evaluated by combining the results of nine n-2-cells...
                 cell_ref inw = q.nw->result(space, level-1);
@@ -160,40 +242,247 @@ namespace hlife {
                 cell_ref gse = get_cell(space, ix, ie, is, ise);
 
                 // ... and then into a single n-1-cell
-                q.future = &get_cell(space,
+                return publish(get_cell(space,
                         gnw.result(space, level-1),
                         gne.result(space, level-1),
                         gsw.result(space, level-1),
-                        gse.result(space, level-1));
+                        gse.result(space, level-1)));
+            }
+        }
+
+        // Evaluates this cell like result(), but only 2^exponent generations
+        // into the future, for exponents up to level-2. Results are memoised
+        // per exponent in a side table of the cellspace.
+        template <typename Rule>
+        cell_ref result(basic_cellspace<Rule>& space, int level, int exponent) const {
+            assert(exponent >= 0 && exponent <= level-2);
+            if(exponent == level-2) return result(space, level);
+
+            if(cell_ptr memo = get_memo(space, *this, exponent)) {
+                space.counters.count_step(level, true);
+                return *memo;
+            }
+            space.counters.count_step(level, false);
+
+            // 4-cells are advanced by less than the kernel's four generations.
+            if(level == 4) {
+                return set_memo(space, *this, level, exponent,
+                        get_tile(space, evolve<Rule>(q.nw->tile, q.ne->tile, q.sw->tile, q.se->tile, 1 << exponent)));
+            }
+
+            // n-cells are evaluated by taking the centers of nine n-1-cells
+            // as they are now...
+            cell_ref inw = center_of(space, level-1, *q.nw->q.nw, *q.nw->q.ne, *q.nw->q.sw, *q.nw->q.se);
+            cell_ref in  = center_of(space, level-1, *q.nw->q.ne, *q.ne->q.nw, *q.nw->q.se, *q.ne->q.sw);
+            cell_ref ine = center_of(space, level-1, *q.ne->q.nw, *q.ne->q.ne, *q.ne->q.sw, *q.ne->q.se);
+            cell_ref iw  = center_of(space, level-1, *q.nw->q.sw, *q.nw->q.se, *q.sw->q.nw, *q.sw->q.ne);
+            cell_ref ix  = center_of(space, level-1, *q.nw->q.se, *q.ne->q.sw, *q.sw->q.ne, *q.se->q.nw);
+            cell_ref ie  = center_of(space, level-1, *q.ne->q.sw, *q.ne->q.se, *q.se->q.nw, *q.se->q.ne);
+            cell_ref isw = center_of(space, level-1, *q.sw->q.nw, *q.sw->q.ne, *q.sw->q.sw, *q.sw->q.se);
+            cell_ref is  = center_of(space, level-1, *q.sw->q.ne, *q.se->q.nw, *q.sw->q.se, *q.se->q.sw);
+            cell_ref ise = center_of(space, level-1, *q.se->q.nw, *q.se->q.ne, *q.se->q.sw, *q.se->q.se);
+
+            // ... into four n-1-cells, and then advancing those into a single
+            // n-1-cell.
+            return set_memo(space, *this, level, exponent, get_cell(space,
+                    get_cell(space, inw, in, iw, ix).result(space, level-1, exponent),
+                    get_cell(space, in, ine, ix, ie).result(space, level-1, exponent),
+                    get_cell(space, iw, ix, isw, is).result(space, level-1, exponent),
+                    get_cell(space, ix, ie, is, ise).result(space, level-1, exponent)));
+        }
+
+        // The central quadrant, at the same time, of the n-cell with the given
+        // quadrants. The n-cell itself is not created.
+        template <typename Rule>
+        static cell_ref center_of(basic_cellspace<Rule>& space, int level, cell_ref nw, cell_ref ne, cell_ref sw, cell_ref se) {
+            if(level == 4) return get_tile(space, evolve<Rule>(nw.tile, ne.tile, sw.tile, se.tile, 0));
+            return get_cell(space, *nw.q.se, *ne.q.sw, *sw.q.ne, *se.q.nw);
+        }
+
+        // Side table access for results with smaller steps.
+        template <typename Rule>
+        static cell_ptr get_memo(basic_cellspace<Rule>& space, cell_ref c, int exponent);
+        template <typename Rule>
+        static cell_ref set_memo(basic_cellspace<Rule>& space, cell_ref c, int level, int exponent, cell_ref result);
+
+        // Evaluates this cell like result(), forking the independent
+        // sub-results as tasks of the current task_pool above the cutoff
+        // level, and evaluating sequentially at or below it.
+        template <typename Rule>
+        cell_ref parallel_result(basic_cellspace<Rule>& space, int level, int cutoff) const {
+            if(level <= cutoff || level <= 4) return result(space, level);
+
+            if(cell_ptr future = q.future.load(std::memory_order_acquire)) {
+                space.counters.count_result(level, true);
+                return *future;
             }
-            return *q.future;
+            space.counters.count_result(level, false);
+
+            // The nine n-2-cell results are independent...
+            cell_ptr i[9];
+            {
+                task_group group;
+                auto fork = [&](cell_ptr& out, cell_ref c) {
+                    group.run([&out, &c, &space, level, cutoff] {
+                        out = &c.parallel_result(space, level-1, cutoff);
+                    });
+                };
+                fork(i[0], *q.nw);
+                fork(i[1], get_cell(space, *q.nw->q.ne, *q.ne->q.nw, *q.nw->q.se, *q.ne->q.sw));
+                fork(i[2], *q.ne);
+                fork(i[3], get_cell(space, *q.nw->q.sw, *q.nw->q.se, *q.sw->q.nw, *q.sw->q.ne));
+                fork(i[4], get_cell(space, *q.nw->q.se, *q.ne->q.sw, *q.sw->q.ne, *q.se->q.nw));
+                fork(i[5], get_cell(space, *q.ne->q.sw, *q.ne->q.se, *q.se->q.nw, *q.se->q.ne));
+                fork(i[6], *q.sw);
+                fork(i[7], get_cell(space, *q.sw->q.ne, *q.se->q.nw, *q.sw->q.se, *q.se->q.sw));
+                fork(i[8], *q.se);
+                group.wait();
+            }
+
+            // ... and so are the four n-1-cell results built from them.
+            cell_ptr g[4];
+            {
+                task_group group;
+                auto fork = [&](cell_ptr& out, cell_ref c) {
+                    group.run([&out, &c, &space, level, cutoff] {
+                        out = &c.parallel_result(space, level-1, cutoff);
+                    });
+                };
+                fork(g[0], get_cell(space, *i[0], *i[1], *i[3], *i[4]));
+                fork(g[1], get_cell(space, *i[1], *i[2], *i[4], *i[5]));
+                fork(g[2], get_cell(space, *i[3], *i[4], *i[6], *i[7]));
+                fork(g[3], get_cell(space, *i[4], *i[5], *i[7], *i[8]));
+                group.wait();
+            }
+
+            return publish(get_cell(space, *g[0], *g[1], *g[2], *g[3]));
+        }
+
+        // Evaluates this cell like result(space, level, exponent), forking
+        // the four sub-results as tasks of the current task_pool above the
+        // cutoff level. The nine cells they are built from are only
+        // rearranged, not evaluated, so they are not worth forking.
+        template <typename Rule>
+        cell_ref parallel_result(basic_cellspace<Rule>& space, int level, int exponent, int cutoff) const {
+            assert(exponent >= 0 && exponent <= level-2);
+            if(exponent == level-2) return parallel_result(space, level, cutoff);
+            if(level <= cutoff || level <= 4) return result(space, level, exponent);
+
+            if(cell_ptr memo = get_memo(space, *this, exponent)) {
+                space.counters.count_step(level, true);
+                return *memo;
+            }
+            space.counters.count_step(level, false);
+
+            cell_ref inw = center_of(space, level-1, *q.nw->q.nw, *q.nw->q.ne, *q.nw->q.sw, *q.nw->q.se);
+            cell_ref in  = center_of(space, level-1, *q.nw->q.ne, *q.ne->q.nw, *q.nw->q.se, *q.ne->q.sw);
+            cell_ref ine = center_of(space, level-1, *q.ne->q.nw, *q.ne->q.ne, *q.ne->q.sw, *q.ne->q.se);
+            cell_ref iw  = center_of(space, level-1, *q.nw->q.sw, *q.nw->q.se, *q.sw->q.nw, *q.sw->q.ne);
+            cell_ref ix  = center_of(space, level-1, *q.nw->q.se, *q.ne->q.sw, *q.sw->q.ne, *q.se->q.nw);
+            cell_ref ie  = center_of(space, level-1, *q.ne->q.sw, *q.ne->q.se, *q.se->q.nw, *q.se->q.ne);
+            cell_ref isw = center_of(space, level-1, *q.sw->q.nw, *q.sw->q.ne, *q.sw->q.sw, *q.sw->q.se);
+            cell_ref is  = center_of(space, level-1, *q.sw->q.ne, *q.se->q.nw, *q.sw->q.se, *q.se->q.sw);
+            cell_ref ise = center_of(space, level-1, *q.se->q.nw, *q.se->q.ne, *q.se->q.sw, *q.se->q.se);
+
+            cell_ptr g[4];
+            {
+                task_group group;
+                auto fork = [&](cell_ptr& out, cell_ref c) {
+                    group.run([&out, &c, &space, level, exponent, cutoff] {
+                        out = &c.parallel_result(space, level-1, exponent, cutoff);
+                    });
+                };
+                fork(g[0], get_cell(space, inw, in, iw, ix));
+                fork(g[1], get_cell(space, in, ine, ix, ie));
+                fork(g[2], get_cell(space, iw, ix, isw, is));
+                fork(g[3], get_cell(space, ix, ie, is, ise));
+                group.wait();
+            }
+
+            return set_memo(space, *this, level, exponent, get_cell(space, *g[0], *g[1], *g[2], *g[3]));
+        }
+
+        // Memoises the future of this cell.
+        cell_ref publish(cell_ref future) const {
+            q.future.store(&future, std::memory_order_release);
+            return future;
         }
 
         // Evaluates the pseudo-quadrant that straddles the four quadrants in
         // the center.
-        cell_ref result_center(cellspace& space, int level) const {
+        template <typename Rule>
+        cell_ref result_center(basic_cellspace<Rule>& space, int level) const {
             return get_cell(space, *q.nw->q.se, *q.ne->q.sw, *q.sw->q.ne, *q.se->q.nw).result(space, level);
         }
         // Evaluates the pseudo-quadrant that straddles the two given quadrants
         // horizontally.
-        friend cell_ref result_horizontal(cellspace& space, int level, cell_ref w, cell_ref e) {
+        template <typename Rule>
+        friend cell_ref result_horizontal(basic_cellspace<Rule>& space, int level, cell_ref w, cell_ref e) {
             return cell::get_cell(space, *w.q.ne, *e.q.nw, *w.q.se, *e.q.sw).result(space, level);
         }
         // Evaluates the pseudo-quadrant that straddles the two given quadrants
         // vertically.
-        friend cell_ref result_vertical(cellspace& space, int level, cell_ref n, cell_ref s) {
+        template <typename Rule>
+        friend cell_ref result_vertical(basic_cellspace<Rule>& space, int level, cell_ref n, cell_ref s) {
             return cell::get_cell(space, *n.q.sw, *n.q.se, *s.q.nw, *s.q.ne).result(space, level);
         }
 
-        // Chooses the right next generation 0-cell for a given cell state and
-        // number of live neighbours.
-        static cell_ref future_leaf(cellspace& space, int neighbours, bool alive) {
-            if(neighbours == 2 && alive) return live(space);
-            if(neighbours == 3) return live(space);
-            return dead(space);
+        // Tiles pack 8x8 cells into 64 bits, row by row from the top, with
+        // the westmost cell of each row in the most significant bit.
+        static unsigned tile_row(std::uint64_t tile, int y) {
+            return static_cast<unsigned>(tile >> (56 - 8*y)) & 0xff;
         }
 
-        operator bool() const { return alive; }
+        // Computes the next generation of the 16-wide middle row b given the
+        // rows a above and c below it. Neighbour counts are summed for all
+        // sixteen cells at once with bit-sliced adders.
+        template <typename Rule>
+        static std::uint32_t evolve_row(std::uint32_t a, std::uint32_t b, std::uint32_t c) {
+            // sum of the three cells above, and below: s + 2c
+            std::uint32_t sa, ca, sc, cc;
+            full_add(a << 1, a, a >> 1, sa, ca);
+            full_add(c << 1, c, c >> 1, sc, cc);
+            // sum of the two cells beside: s + 2c
+            std::uint32_t sb = (b << 1) ^ (b >> 1);
+            std::uint32_t cb = (b << 1) & (b >> 1);
+            // total in binary: s0 + 2s1 + 4s2 + 8s3
+            std::uint32_t s0, k1, t1, t2;
+            full_add(sa, sb, sc, s0, k1);
+            full_add(ca, cb, cc, t1, t2);
+            std::uint32_t s1 = k1 ^ t1;
+            std::uint32_t s2 = t2 ^ (k1 & t1);
+            std::uint32_t s3 = t2 & k1 & t1;
+            return Rule::next(b, s0, s1, s2, s3) & 0xffff;
+        }
+        static void full_add(std::uint32_t x, std::uint32_t y, std::uint32_t z, std::uint32_t& sum, std::uint32_t& carry) {
+            std::uint32_t t = x ^ y;
+            sum = t ^ z;
+            carry = (x & y) | (t & z);
+        }
+
+        // Advances the 16x16 block made of four tiles by the given number of
+        // generations, up to four, and returns its central tile.
+        template <typename Rule>
+        static std::uint64_t evolve(std::uint64_t nw, std::uint64_t ne, std::uint64_t sw, std::uint64_t se, int generations) {
+            assert(generations >= 0 && generations <= 4);
+            std::uint32_t rows[16];
+            for(int y = 0; y < 8; ++y) {
+                rows[y]   = tile_row(nw, y) << 8 | tile_row(ne, y);
+                rows[y+8] = tile_row(sw, y) << 8 | tile_row(se, y);
+            }
+            // Each generation the valid region shrinks by one cell on each side.
+            for(int g = 1; g <= generations; ++g) {
+                std::uint32_t above = rows[g-1];
+                for(int y = g; y < 16-g; ++y) {
+                    std::uint32_t current = rows[y];
+                    rows[y] = evolve_row<Rule>(above, current, rows[y+1]);
+                    above = current;
+                }
+            }
+            std::uint64_t center = 0;
+            for(int y = 4; y < 12; ++y) center = center << 8 | ((rows[y] >> 4) & 0xff);
+            return center;
+        }
 
         // This is an immovable brick as its identity somewhat relies on its
         // address
@@ -201,107 +490,896 @@ namespace hlife {
         cell& operator=(cell const&) = delete;
         ~cell() = default;
 
-        // Definition of cell equivalent for use in a hash set.
-        friend struct equivalence;
+        // Definition of cell equivalence for use in the cellspace's hash-cons
+        // tables. Macro-cells are keyed on the identities of their four
+        // quadrants, and tiles on their bits.
+        template <typename Rule>
+        friend struct basic_cellspace;
+        template <typename Rule>
+        friend struct basic_world;
+        friend struct patterns;
         struct equivalence {
-            static std::size_t combine() { return 0; }
-            template <typename... Args>
-            static std::size_t combine(std::size_t n, Args... args) {
-                std::size_t seed = combine(args...);
-                return seed ^ (n + 0x9e3779b9 + (seed<<6) + (seed>>2));
+            // Multiplicative mixing of the four quadrant addresses followed by
+            // a 64-bit finaliser. Cell addresses are aligned and clustered in
+            // slabs, so the low bits carry little information on their own.
+            static std::uint64_t hash(cell_ptr nw, cell_ptr ne, cell_ptr sw, cell_ptr se) {
+                std::uint64_t h = reinterpret_cast<std::uintptr_t>(nw);
+                h = h * multiplier + reinterpret_cast<std::uintptr_t>(ne);
+                h = h * multiplier + reinterpret_cast<std::uintptr_t>(sw);
+                h = h * multiplier + reinterpret_cast<std::uintptr_t>(se);
+                return finalise(h);
             }
-            std::size_t operator()(cell_ref c) const { // hash
-                std::hash<cell_ptr> h;
-                return combine(h(c.q.nw), h(c.q.ne), h(c.q.sw), h(c.q.se));
+            static std::uint64_t hash(std::uint64_t tile) {
+                return finalise(tile * multiplier);
             }
-            bool operator()(cell_ref a, cell_ref b) const { // equivalence
-                return a.q.nw == b.q.nw && a.q.ne == b.q.ne && a.q.sw == b.q.sw && a.q.se == b.q.se;
+            static std::uint64_t finalise(std::uint64_t h) {
+                h ^= h >> 32;
+                h *= 0xd6e8feb86659fd93ull;
+                h ^= h >> 32;
+                return h;
             }
+            static bool equal(cell_ref c, cell_ptr nw, cell_ptr ne, cell_ptr sw, cell_ptr se) {
+                return c.q.nw == nw && c.q.ne == ne && c.q.sw == sw && c.q.se == se;
+            }
+            static constexpr std::uint64_t multiplier = 0x9e3779b97f4a7c15ull;
         };
 
-        // A cell is either a leaf which can be alive or not...
-        bool alive;
+        static constexpr std::uint64_t unknown_population = ~std::uint64_t(0);
+        static constexpr std::uint64_t max_population = unknown_population - 1;
+
+        // A cell is either a leaf tile of 8x8 cells...
+        std::uint64_t tile;
         // ... or it is a macro-cell that links to other cells.
-        struct {
+        struct quadrants {
+            quadrants(cell_ref nw, cell_ref ne, cell_ref sw, cell_ref se)
+            : nw(&nw), ne(&ne), sw(&sw), se(&se), future(nullptr), population(unknown_population) {}
+
             // The four cell quadrants.
             cell_ptr nw, ne, sw, se;
             // The cell obtained by evaluating the future of this cell.
-            // This is mutable because it is evaluated lazily.
-            mutable cell_ptr future;
+            // This is mutable because it is evaluated lazily. It is atomic
+            // because parallel evaluation may publish it from any thread; two
+            // threads racing to publish it always store the same cell.
+            mutable std::atomic<cell_ptr> future;
+            // The number of live cells, or unknown_population until it is
+            // first counted.
+            mutable std::atomic<std::uint64_t> population;
         } q;
         // No tagging is used to tell the two apart; all operations know which
         // kind of cell they work on from context.
     };
 
-    // A cellspace is the set of all possible cells.
-    struct cellspace {
+    // A cellspace is the set of all possible cells. All cells of a cellspace
+    // evolve under the same rule.
+    template <typename Rule>
+    struct basic_cellspace {
     public:
-        cellspace() {
-            // 0-cells and 1-cells cannot be generated through the recursive
-            // process, so they need to be pre-seeded.
+        // Tiles are the smallest cells; they are created lazily like the rest.
+        basic_cellspace() = default;
 
-            // 0-cells (leaves) are static locals obtained from factories.
-            // They don't live in the hash set as they cannot be hashed.
-            auto leaf_of = [this](bool b) -> cell_ref { return b? live_cell() : dead_cell(); };
+        // The empty cell with sides 2^level. Empty cells are kept alive for as
+        // long as the cellspace. This is not safe to call during parallel
+        // evaluation.
+        cell_ref empty_cell(int level) const {
+            assert(level >= tile_level);
+            if(empties.empty()) empties.push_back(&tile_with(0));
+            while(static_cast<int>(empties.size()) <= level - tile_level) {
+                cell_ref e = *empties.back();
+                empties.push_back(&cell_with(e, e, e, e));
+            }
+            return *empties[level - tile_level];
+        }
 
-            // Pre-generate all 16 1-cells from bit patterns 0-15.
-            for(int i = 0; i < 16; ++i)
-                cell_with(leaf_of(i&8), leaf_of(i&4), leaf_of(i&2), leaf_of(i&1));
+        // Obtains a cell with the given quadrants. Cells are created lazily
+        // when requested for the first time. This is safe to call from
+        // several threads at once within a concurrent_scope. A cellspace
+        // holds up to 2^32-1 cells; creating more throws std::length_error.
+        cell_ref cell_with(cell_ref nw, cell_ref ne, cell_ref sw, cell_ref se) const {
+            return find_or_insert(nodes, node_key{ &nw, &ne, &sw, &se });
+        }
+        // Obtains the tile with the given 8x8 bits, packed as described for
+        // cell::tile_row. Tiles are created lazily too.
+        cell_ref tile_with(std::uint64_t bits) const {
+            return find_or_insert(tiles, tile_key{ bits });
         }
 
-        // The one live cell.
-        cell_ref live_cell() const {
-            static cell_ref live = cell(cell::key(), true);
-            return live;
+        // Memoised results of advancing cells by fewer generations than
+        // cell::result() does, keyed by cell and the step's power of two.
+        // Like cell_with(), these are safe to call from several threads at
+        // once within a concurrent_scope.
+        cell_ptr step_result(cell_ref c, int exponent) const {
+            std::uint64_t hash = step_hash(c, exponent);
+            step_shard& s = steps[hash >> (64 - shard_bits)];
+            if(!concurrent.load(std::memory_order_relaxed)) return find_step(s, hash, c, exponent);
+            std::lock_guard<spinlock> lock(s.lock);
+            return find_step(s, hash, c, exponent);
         }
-        // The one dead cell.
-        cell_ref dead_cell() const {
-            static cell_ref dead = cell(cell::key(), false);
-            return dead;
+        void memoise_step(cell_ref c, int level, int exponent, cell_ref result) const {
+            std::uint64_t hash = step_hash(c, exponent);
+            step_shard& s = steps[hash >> (64 - shard_bits)];
+            if(!concurrent.load(std::memory_order_relaxed)) return insert_step(s, hash, step_slot{ &c, &result, exponent, level });
+            std::lock_guard<spinlock> lock(s.lock);
+            insert_step(s, hash, step_slot{ &c, &result, exponent, level });
         }
 
-        // Obtains a cell with the given quadrants. Cells are created lazily
-        // when requested for the first time.
-        cell_ref cell_with(cell_ref nw, cell_ref ne, cell_ref sw, cell_ref se) const {
-            return *cells.emplace(cell::key(), nw, ne, sw, se).first;
+        // While alive, makes cell_with() and the memoised steps take the
+        // locks needed for several threads to use them at once. Sequential
+        // use skips them.
+        struct concurrent_scope {
+        public:
+            explicit concurrent_scope(basic_cellspace const& space) : space(space) {
+                space.concurrent.store(true, std::memory_order_relaxed);
+            }
+            ~concurrent_scope() { space.concurrent.store(false, std::memory_order_relaxed); }
+
+            concurrent_scope(concurrent_scope const&) = delete;
+            concurrent_scope& operator=(concurrent_scope const&) = delete;
+
+        private:
+            basic_cellspace const& space;
+        };
+
+        // Number of cells currently in the cellspace, tiles included.
+        std::size_t size() const {
+            std::size_t n = 0;
+            for(auto const& s : nodes) n += s.count;
+            for(auto const& s : tiles) n += s.count;
+            return n;
+        }
+
+        // Bytes held by the cellspace, including cell slabs, the index and the
+        // memoised smaller steps.
+        std::size_t memory_usage() const {
+            return slab_count * slab_cells * sizeof(cell) + index_memory() + step_memory();
+        }
+        // Bytes used by live cells, the index and the memoised smaller steps.
+        // Slab space freed by garbage collection is reused before new slabs
+        // are allocated.
+        std::size_t memory_in_use() const {
+            return size() * sizeof(cell) + index_memory() + step_memory();
+        }
+
+        // Registers a cell with sides 2^level as a root for garbage
+        // collection. Roots and everything reachable from them survive
+        // collections. A cell may be registered several times and stays a
+        // root until unregistered as many times.
+        void add_root(cell_ref c, int level) { roots.emplace_back(&c, level); }
+        void remove_root(cell_ref c, int level) {
+            auto it = std::find(roots.begin(), roots.end(), std::make_pair(&c, level));
+            assert(it != roots.end());
+            roots.erase(it);
+        }
+
+        // Sets the memory budget, in bytes in use, above which
+        // collect_if_needed() collects garbage. Zero means unbounded. When
+        // keep_futures is false, collections also forget the memoised futures
+        // of surviving cells unless those futures are reachable on their own.
+        void set_budget(std::size_t bytes, bool keep_futures = true) {
+            budget = bytes;
+            threshold = bytes;
+            keep_memo = keep_futures;
+        }
+
+        // Collects garbage if the memory in use exceeds the budget. Returns
+        // whether a collection took place. This must only be called when no
+        // unrooted cells are in use, as those may be collected, and never
+        // concurrently with evaluation.
+        bool collect_if_needed() {
+            if(budget == 0 || memory_in_use() <= threshold) return false;
+            collect(keep_memo);
+            // If the reachable set alone is close to the budget, give it some
+            // room to avoid collecting on every check.
+            threshold = std::max(budget, 2 * memory_in_use());
+            return true;
+        }
+
+        // Mark-and-sweep collection of all cells not reachable from the roots
+        // and the empty cells. Memoised futures are followed when
+        // keep_futures is true and are otherwise cleared unless marked. The
+        // index is rebuilt from the survivors so canonicity is preserved.
+        void collect(bool keep_futures = true) {
+            // Without keep_futures, survivors with a future are listed to
+            // check that future once everything is marked.
+            marks marked = unmarked();
+            std::vector<std::pair<cell_ptr, int>> memoised;
+            mark(marked, keep_futures, [&](cell_ptr c, int level) {
+                if(!keep_futures && level != tile_level && c->q.future.load(std::memory_order_relaxed))
+                    memoised.emplace_back(c, level);
+            });
+            auto is_marked = [&](cell_ref c, int level) { return mark_of(marked, c, level); };
+
+            // Survivors forget futures that are about to be swept.
+            for(auto const& m : memoised) {
+                cell_ptr future = m.first->q.future.load(std::memory_order_relaxed);
+                if(!is_marked(*future, m.second-1)) m.first->q.future.store(nullptr, std::memory_order_relaxed);
+            }
+            // Memoised smaller steps are weak: they are kept only when both
+            // ends survive on their own.
+            for(auto& s : steps) {
+                std::vector<step_slot> survivors;
+                for(auto const& x : s.index)
+                    if(x.c && is_marked(*x.c, x.level) && is_marked(*x.result, x.level-1)) survivors.push_back(x);
+                s.count = survivors.size();
+                s.index.swap(survivors);
+                rehash_steps(s, fitting_size(s.count));
+            }
+
+            sweep<node_key>(nodes, marked.nodes);
+            sweep<tile_key>(tiles, marked.tiles);
+        }
+
+        // A snapshot of the activity of the cellspace since it was created.
+        // Counts are only collected when HLIFE_STATS is defined.
+        cellspace_stats stats() const {
+            cellspace_stats s = stats_enabled? counters.total() : cellspace_stats();
+            s.cells = size();
+            s.memory_in_use = memory_in_use();
+            return s;
+        }
+
+        // The number of cells of each level reachable from the roots and the
+        // empty cells, memoised futures included. This walks all those cells.
+        std::vector<std::size_t> cells_per_level() const {
+            std::vector<std::size_t> counts;
+            marks marked = unmarked();
+            mark(marked, true, [&](cell_ptr, int level) {
+                if(counts.size() <= static_cast<std::size_t>(level)) counts.resize(level + 1);
+                ++counts[level];
+            });
+            return counts;
         }
 
     private:
-        mutable std::unordered_set<cell, cell::equivalence, cell::equivalence> cells;
+        // Tiles are cells with sides 2^3.
+        static constexpr int tile_level = 3;
+
+        // Cells are allocated from large slabs so their addresses are stable
+        // for the lifetime of the cellspace and no allocation is made per cell.
+        // Slabs are listed in a directory of fixed size so that it can be read
+        // while another thread adds a slab.
+        static constexpr std::size_t slab_bits = 16;
+        static constexpr std::size_t slab_cells = std::size_t(1) << slab_bits;
+        static constexpr std::size_t max_slabs = std::size_t(1) << (32 - slab_bits);
+        static constexpr std::size_t initial_index_size = std::size_t(1) << 6;
+        static constexpr std::size_t npos = std::size_t(-1);
+        using storage = std::aligned_storage<sizeof(cell), alignof(cell)>::type;
+
+        // Each index is split in shards, selected by the top bits of the hash,
+        // each with its own lock and open-addressing table, so that threads
+        // evaluating different cells rarely contend.
+        static constexpr std::size_t shard_bits = 6;
+        static constexpr std::size_t shard_count = std::size_t(1) << shard_bits;
+
+        // Locks are held only for a probe and the odd allocation.
+        struct spinlock {
+            void lock() { while(flag.test_and_set(std::memory_order_acquire)) std::this_thread::yield(); }
+            void unlock() { flag.clear(std::memory_order_release); }
+            std::atomic_flag flag = ATOMIC_FLAG_INIT;
+        };
+
+        // An entry in the open-addressing index. Cells are referred to by a
+        // 1-based id into the slabs; id 0 marks an empty slot.
+        struct slot {
+            std::uint32_t tag;
+            std::uint32_t id;
+        };
+
+        template <typename Slot>
+        struct basic_shard {
+            spinlock lock;
+            std::vector<Slot> index;
+            std::size_t count = 0;
+        };
+        using shard = basic_shard<slot>;
+        using shards = std::array<shard, shard_count>;
+
+        // An entry in the side table of smaller steps, keyed by the cell and
+        // the step's power of two. The cell's level is kept for the
+        // collector. A null cell marks an empty slot.
+        struct step_slot {
+            cell_ptr c;
+            cell_ptr result;
+            int exponent;
+            int level;
+        };
+        using step_shard = basic_shard<step_slot>;
+
+        // Keys for the two indices: macro-cells and tiles.
+        struct node_key {
+            static constexpr bool is_tile = false;
+            cell_ptr nw, ne, sw, se;
+            std::uint64_t hash() const { return cell::equivalence::hash(nw, ne, sw, se); }
+            bool matches(cell_ref c) const { return cell::equivalence::equal(c, nw, ne, sw, se); }
+            void build(void* where) const { new (where) cell(cell::key(), *nw, *ne, *sw, *se); }
+            static std::uint64_t hash_of(cell_ref c) { return cell::equivalence::hash(c.q.nw, c.q.ne, c.q.sw, c.q.se); }
+        };
+        struct tile_key {
+            static constexpr bool is_tile = true;
+            std::uint64_t bits;
+            std::uint64_t hash() const { return cell::equivalence::hash(bits); }
+            bool matches(cell_ref c) const { return c.tile == bits; }
+            void build(void* where) const { new (where) cell(cell::key(), bits); }
+            static std::uint64_t hash_of(cell_ref c) { return cell::equivalence::hash(c.tile); }
+        };
+
+        template <typename Key>
+        cell_ref find_or_insert(shards& index, Key const& key) const {
+            std::uint64_t hash = key.hash();
+            shard& s = index[hash >> (64 - shard_bits)];
+            if(!concurrent.load(std::memory_order_relaxed)) return find_or_insert(s, hash, key);
+            std::lock_guard<spinlock> lock(s.lock);
+            return find_or_insert(s, hash, key);
+        }
+
+        template <typename Key>
+        cell_ref find_or_insert(shard& s, std::uint64_t hash, Key const& key) const {
+            // Keep the load factor at or below 1/2 so probe chains stay short.
+            if(2 * (s.count + 1) > s.index.size()) rehash<Key>(s, s.index.empty()? std::size_t(initial_index_size) : 2 * s.index.size());
+
+            // Linear probing over 8-byte slots, eight to a cache line. Slots
+            // carry the upper half of the hash as a tag so that mismatches are
+            // usually rejected without touching the cell itself.
+            std::uint32_t tag = static_cast<std::uint32_t>(hash >> 32);
+            std::size_t mask = s.index.size() - 1;
+            for(std::size_t i = hash & mask, probes = 1;; i = (i + 1) & mask, ++probes) {
+                slot& x = s.index[i];
+                if(!x.id) {
+                    x.id = allocate();
+                    x.tag = tag;
+                    key.build(const_cast<cell*>(&at(x.id)));
+                    ++s.count;
+                    counters.count_lookup(Key::is_tile, true, probes);
+                    return at(x.id);
+                }
+                if(x.tag == tag && key.matches(at(x.id))) {
+                    counters.count_lookup(Key::is_tile, false, probes);
+                    return at(x.id);
+                }
+            }
+        }
+
+        // Finds the index slot of a cell in its shard. Returns npos if there
+        // is none.
+        template <typename Key>
+        std::size_t find_slot(shards const& index, Key const& key, cell_ref c) const {
+            std::uint64_t hash = key.hash();
+            shard const& s = index[hash >> (64 - shard_bits)];
+            std::uint32_t tag = static_cast<std::uint32_t>(hash >> 32);
+            std::size_t mask = s.index.size() - 1;
+            for(std::size_t i = hash & mask;; i = (i + 1) & mask) {
+                if(!s.index[i].id) return npos;
+                if(s.index[i].tag == tag && &at(s.index[i].id) == &c) return i;
+            }
+        }
+
+        // Marks are kept by slot, which is found by looking the cell up in
+        // the index. The level tells tiles apart from macro-cells.
+        struct marks {
+            std::vector<std::vector<bool>> nodes, tiles;
+        };
+
+        marks unmarked() const {
+            marks m { std::vector<std::vector<bool>>(shard_count), std::vector<std::vector<bool>>(shard_count) };
+            for(std::size_t n = 0; n < shard_count; ++n) {
+                m.nodes[n].assign(nodes[n].index.size(), false);
+                m.tiles[n].assign(tiles[n].index.size(), false);
+            }
+            return m;
+        }
+
+        std::vector<bool>::reference mark_of(marks& m, cell_ref c, int level) const {
+            if(level == tile_level) return mark_of(tiles, m.tiles, tile_key{ c.tile }, c);
+            return mark_of(nodes, m.nodes, node_key{ c.q.nw, c.q.ne, c.q.sw, c.q.se }, c);
+        }
+        template <typename Key>
+        std::vector<bool>::reference mark_of(shards const& index, std::vector<std::vector<bool>>& marks, Key const& key, cell_ref c) const {
+            std::size_t i = find_slot(index, key, c);
+            assert(i != npos);
+            return marks[key.hash() >> (64 - shard_bits)][i];
+        }
+
+        // Marks the cells reachable from the roots and the empty cells,
+        // following memoised futures if asked to. Each cell is visited with
+        // its level as it is marked.
+        template <typename Visit>
+        void mark(marks& m, bool follow_futures, Visit visit) const {
+            std::vector<std::pair<cell_ptr, int>> pending(roots);
+            for(std::size_t i = 0; i < empties.size(); ++i)
+                pending.emplace_back(empties[i], static_cast<int>(i) + tile_level);
+
+            while(!pending.empty()) {
+                cell_ptr c = pending.back().first;
+                int level = pending.back().second;
+                pending.pop_back();
+                auto marked = mark_of(m, *c, level);
+                if(marked) continue;
+                marked = true;
+                visit(c, level);
+                if(level == tile_level) continue;
+                pending.emplace_back(c->q.nw, level-1);
+                pending.emplace_back(c->q.ne, level-1);
+                pending.emplace_back(c->q.sw, level-1);
+                pending.emplace_back(c->q.se, level-1);
+                if(!follow_futures) continue;
+                if(cell_ptr future = c->q.future.load(std::memory_order_relaxed)) pending.emplace_back(future, level-1);
+            }
+        }
+
+        cell_ref at(std::uint32_t id) const {
+            std::uint32_t n = id - 1;
+            return *reinterpret_cast<cell_ptr>(&slabs[n >> slab_bits][n & (slab_cells - 1)]);
+        }
+
+        std::uint32_t allocate() const {
+            if(!concurrent.load(std::memory_order_relaxed)) return next_id();
+            std::lock_guard<spinlock> lock(arena_lock);
+            return next_id();
+        }
+
+        // Ids are 32-bit and 0 marks empty slots, so the last cell of the last
+        // slab is never used. Running out of ids throws std::length_error.
+        std::uint32_t next_id() const {
+            if(!free_ids.empty()) {
+                std::uint32_t id = free_ids.back();
+                free_ids.pop_back();
+                return id;
+            }
+            if(slab_count == max_slabs && slab_used == slab_cells - 1) throw std::length_error("cellspace is full");
+            if(slab_count == 0 || slab_used == slab_cells) {
+                std::unique_ptr<storage[]> slab(new storage[slab_cells]);
+                slabs[slab_count++] = std::move(slab);
+                slab_used = 0;
+            }
+            return static_cast<std::uint32_t>(((slab_count - 1) << slab_bits) + slab_used++ + 1);
+        }
+
+        // Grows the index of a shard to the given power-of-two size. Cells
+        // never move, so only the slots need to be redistributed.
+        template <typename Key>
+        void rehash(shard& s, std::size_t size) const {
+            std::vector<slot> bigger(size, slot{ 0, 0 });
+            std::size_t mask = size - 1;
+            for(auto const& x : s.index) {
+                if(!x.id) continue;
+                std::size_t i = Key::hash_of(at(x.id)) & mask;
+                while(bigger[i].id) i = (i + 1) & mask;
+                bigger[i] = x;
+            }
+            s.index.swap(bigger);
+        }
+
+        // Frees the cells in unmarked slots for reuse. Linear probing does not
+        // support plain removal, so each shard's index is rebuilt from its
+        // survivors, at a size fit for them.
+        template <typename Key>
+        void sweep(shards& index, std::vector<std::vector<bool>> const& marks) {
+            for(std::size_t n = 0; n < shard_count; ++n) {
+                shard& s = index[n];
+                std::vector<slot> survivors;
+                survivors.reserve(s.count);
+                for(std::size_t i = 0; i < s.index.size(); ++i) {
+                    if(!s.index[i].id) continue;
+                    if(marks[n][i]) survivors.push_back(s.index[i]);
+                    else free_ids.push_back(s.index[i].id);
+                }
+                s.count = survivors.size();
+                s.index.swap(survivors);
+                rehash<Key>(s, fitting_size(s.count));
+            }
+        }
+
+        // The size of an index that holds the given number of entries at a
+        // load factor of 1/2 or less.
+        static std::size_t fitting_size(std::size_t count) {
+            std::size_t size = initial_index_size;
+            while(2 * count > size) size *= 2;
+            return size;
+        }
+
+        std::size_t index_memory() const {
+            std::size_t n = 0;
+            for(auto const& s : nodes) n += s.index.size() * sizeof(slot);
+            for(auto const& s : tiles) n += s.index.size() * sizeof(slot);
+            return n;
+        }
+        std::size_t step_memory() const {
+            std::size_t n = 0;
+            for(auto const& s : steps) n += s.index.size() * sizeof(step_slot);
+            return n;
+        }
+
+        mutable shards nodes;
+        mutable shards tiles;
+        mutable std::atomic<bool> concurrent { false };
+
+        mutable spinlock arena_lock;
+        mutable std::unique_ptr<std::unique_ptr<storage[]>[]> slabs { new std::unique_ptr<storage[]>[max_slabs] };
+        mutable std::size_t slab_count = 0;
+        mutable std::size_t slab_used = 0;
+        mutable std::vector<std::uint32_t> free_ids;
+
+        // The side table of smaller steps is sharded and probed like the
+        // indices of cells, with the cells themselves as keys. Its slots are
+        // three times as large, so it is filled up to 3/4 rather than 1/2.
+        mutable std::array<step_shard, shard_count> steps;
+
+        static std::uint64_t step_hash(cell_ref c, int exponent) {
+            return cell::equivalence::finalise(reinterpret_cast<std::uintptr_t>(&c) * cell::equivalence::multiplier
+                                               + static_cast<std::uint64_t>(exponent));
+        }
+
+        cell_ptr find_step(step_shard const& s, std::uint64_t hash, cell_ref c, int exponent) const {
+            if(s.index.empty()) return nullptr;
+            std::size_t mask = s.index.size() - 1;
+            for(std::size_t i = hash & mask;; i = (i + 1) & mask) {
+                step_slot const& x = s.index[i];
+                if(!x.c) return nullptr;
+                if(x.c == &c && x.exponent == exponent) return x.result;
+            }
+        }
+        void insert_step(step_shard& s, std::uint64_t hash, step_slot const& entry) const {
+            if(4 * (s.count + 1) > 3 * s.index.size()) rehash_steps(s, s.index.empty()? std::size_t(initial_index_size) : 2 * s.index.size());
+            std::size_t mask = s.index.size() - 1;
+            for(std::size_t i = hash & mask;; i = (i + 1) & mask) {
+                step_slot& x = s.index[i];
+                if(!x.c) {
+                    x = entry;
+                    ++s.count;
+                    return;
+                }
+                if(x.c == entry.c && x.exponent == entry.exponent) {
+                    x = entry;
+                    return;
+                }
+            }
+        }
+        void rehash_steps(step_shard& s, std::size_t size) const {
+            std::vector<step_slot> bigger(size, step_slot{ nullptr, nullptr, 0, 0 });
+            std::size_t mask = size - 1;
+            for(auto const& x : s.index) {
+                if(!x.c) continue;
+                std::size_t i = step_hash(*x.c, x.exponent) & mask;
+                while(bigger[i].c) i = (i + 1) & mask;
+                bigger[i] = x;
+            }
+            s.index.swap(bigger);
+        }
+
+        mutable std::vector<cell_ptr> empties;
+        std::vector<std::pair<cell_ptr, int>> roots;
+        std::size_t budget = 0;
+        std::size_t threshold = 0;
+        bool keep_memo = true;
+
+        // The activity of the cellspace. Cells count their evaluations here.
+        friend union cell;
+        stats_counters counters;
     };
 
-    cell_ref cell::live(cellspace& space) { return space.live_cell(); }
-    cell_ref cell::dead(cellspace& space) { return space.dead_cell(); }
-    cell_ref cell::get_cell(cellspace& space, cell_ref nw, cell_ref ne, cell_ref sw, cell_ref se) {
+    template <typename Rule>
+    cell_ref cell::get_cell(basic_cellspace<Rule>& space, cell_ref nw, cell_ref ne, cell_ref sw, cell_ref se) {
         return space.cell_with(nw, ne, sw, se);
     }
+    template <typename Rule>
+    cell_ref cell::get_tile(basic_cellspace<Rule>& space, std::uint64_t bits) {
+        return space.tile_with(bits);
+    }
+    template <typename Rule>
+    cell_ptr cell::get_memo(basic_cellspace<Rule>& space, cell_ref c, int exponent) {
+        return space.step_result(c, exponent);
+    }
+    template <typename Rule>
+    cell_ref cell::set_memo(basic_cellspace<Rule>& space, cell_ref c, int level, int exponent, cell_ref result) {
+        space.memoise_step(c, level, exponent, result);
+        return result;
+    }
 
-    struct world {
+    template <typename Rule>
+    struct basic_world {
     public:
-        // Generates an empty square world with sides 2^level using the given cellspace.
-        world(std::shared_ptr<cellspace> space, int level)
+        // Generates an empty square world with sides 2^level using the given
+        // cellspace. The smallest world that can be stepped has sides 2^4.
+        basic_world(std::shared_ptr<basic_cellspace<Rule>> space, int level)
         : space(std::move(space))
         , level(level)
-        , root([this]() -> cell_ref {
-                // pre-generate emptiness for all cells up to level
-                cell_ptr empty = &this->space->dead_cell();
-                for(int n = 1; n < this->level; ++n) {
-                    // make an empty higher level cell with all four quadrants
-                    // consisting of the previous level's empty cell.
-                    empty = &this->space->cell_with(*empty, *empty, *empty, *empty);
-                }
-                // return the empty cell at the top
-                return *empty;
-            }()) {}
+        , root(&this->space->empty_cell(level)) {
+            this->space->add_root(*root, level);
+        }
+
+        // Wraps an existing cell with sides 2^level as a world.
+        basic_world(std::shared_ptr<basic_cellspace<Rule>> space, cell_ref root, int level)
+        : space(std::move(space))
+        , level(level)
+        , root(&root) {
+            this->space->add_root(root, level);
+        }
+
+        basic_world(basic_world const& other)
+        : space(other.space), level(other.level), root(other.root), generation(other.generation) {
+            space->add_root(*root, level);
+        }
+        basic_world& operator=(basic_world const&) = delete;
+        ~basic_world() { space->remove_root(*root, level); }
+
+        // A change to the state of a single cell. Coordinates grow east and
+        // south from the centre of the world, which stays in place as the
+        // world grows; the world's cells lie in [-2^(level-1), 2^(level-1)).
+        struct edit {
+            std::int64_t x, y;
+            bool alive;
+        };
+
+        // Advances the world by 2^(level-1) generations, half the sides of
+        // the world as the step starts, in a single evaluation. Like
+        // advance(), the world first grows so that nothing is clipped.
+        void step() {
+            evolve(level-1, nullptr, 0);
+        }
 
-        // TODO growth
-        // TODO mutation
-        // TODO display
+        // Advances the world by an arbitrary number of generations, as a sum
+        // of powers of two, each a single evaluation. Before each one the
+        // world grows until the pattern is far enough from the edge that
+        // nothing is clipped.
+        void advance(std::uint64_t generations) {
+            for(int k = 0; generations != 0; ++k, generations >>= 1)
+                if(generations & 1) evolve(k, nullptr, 0);
+        }
+
+        // Sets the state of several cells at once. Edits are sorted along a
+        // Z-order curve so that those within the same cell are contiguous,
+        // and every affected cell is then rebuilt once, bottom-up. Later
+        // edits to the same cell take precedence. The world grows as needed
+        // to hold all the edited cells.
+        void set_cells(std::vector<edit> edits) {
+            assert(level > 3);
+            if(edits.empty()) return;
+            for(auto const& e : edits)
+                while(!contains(e.x, e.y)) grow();
+            std::stable_sort(edits.begin(), edits.end(), [](edit const& a, edit const& b) {
+                std::uint64_t dx = key(a.x) ^ key(b.x), dy = key(a.y) ^ key(b.y);
+                if(dy < dx && dy < (dx ^ dy)) return key(a.x) < key(b.x);
+                return key(a.y) < key(b.y);
+            });
+
+            // The root's quadrants meet at the centre, so they are told apart
+            // by sign.
+            edit const* first = edits.data();
+            edit const* last = first + edits.size();
+            edit const* south = std::partition_point(first, last, [](edit const& e) { return e.y < 0; });
+            edit const* bounds[] = {
+                first,
+                std::partition_point(first, south, [](edit const& e) { return e.x < 0; }),
+                south,
+                std::partition_point(south, last, [](edit const& e) { return e.x < 0; }),
+                last,
+            };
+            cell_ptr q[] = { root->q.nw, root->q.ne, root->q.sw, root->q.se };
+            for(int i = 0; i < 4; ++i)
+                q[i] = &edited(*q[i], level-1, bounds[i], bounds[i+1], 3 - i);
+            replace_root(space->cell_with(*q[0], *q[1], *q[2], *q[3]));
+        }
+        void set_cell(std::int64_t x, std::int64_t y, bool alive) {
+            set_cells({ edit{ x, y, alive } });
+        }
+
+        // Whether the cell at the given coordinates is alive. Cells outside
+        // the world are dead.
+        bool get_cell(std::int64_t x, std::int64_t y) const {
+            assert(level > 3);
+            if(!contains(x, y)) return false;
+            int i = static_cast<int>(key(y) >> 63) << 1 | static_cast<int>(key(x) >> 63);
+            int inward = 3 - i;
+            cell_ptr c = quadrant(*root, i);
+            for(int l = level-1; l > 3; --l)
+                c = quadrant(*c, l >= 64? inward : quadrant_index(l, x, y));
+            return c->tile >> tile_bit(x, y) & 1;
+        }
+
+        // The number of generations the world has been advanced, modulo 2^64.
+        std::uint64_t current_generation() const { return generation; }
+
+        // Advances the world like step() and advance(), evaluating in
+        // parallel on the given pool. Cells at or below the cutoff level are
+        // evaluated sequentially within a single task.
+        void step(task_pool& pool, int cutoff = default_cutoff) {
+            evolve(level-1, &pool, cutoff);
+        }
+        void advance(std::uint64_t generations, task_pool& pool, int cutoff = default_cutoff) {
+            for(int k = 0; generations != 0; ++k, generations >>= 1)
+                if(generations & 1) evolve(k, &pool, cutoff);
+        }
+
+        // The number of live cells in the world, saturated to 64 bits.
+        std::uint64_t population() const { return root->population(level); }
+
+        // Renders a viewport of width x height pixels, each covering a square
+        // of 2^zoom x 2^zoom cells, into the given buffer, row by row. The
+        // top-left pixel covers the cell at (x, y), rounded down to a
+        // multiple of 2^zoom. Pixels hold the fraction of the cells they
+        // cover that are alive. Empty cells are skipped without descending
+        // into them, and cells that fit in a pixel are summed up through
+        // their population instead.
+        void render(std::int64_t x, std::int64_t y, int zoom, std::size_t width, std::size_t height, float* pixels) const {
+            assert(level > 3 && zoom >= 0 && zoom < 64);
+            std::fill(pixels, pixels + width * height, 0.0f);
+            frame f{ key(x) >> zoom, key(y) >> zoom, zoom, width, height, pixels,
+                     static_cast<float>(std::ldexp(1.0, -2 * zoom)) };
+            for(int i = 0; i < 4; ++i) {
+                // Quadrants of the root that are 2^64 or more across are
+                // only visible in their corner at the centre, 2^63 across.
+                std::uint64_t west = level > 64? 0 : (std::uint64_t(1) << 63) - (std::uint64_t(1) << (level-1));
+                std::uint64_t east = std::uint64_t(1) << 63;
+                render(*quadrant(*root, i), level-1, i & 1? east : west, i & 2? east : west, 3 - i, f);
+            }
+        }
 
     private:
-        std::shared_ptr<cellspace> space;
+        friend struct patterns;
+
+        // Below this level there is too little work in a cell to be worth a task.
+        static constexpr int default_cutoff = 8;
+
+        // The root wrapped in an empty border, one level up.
+        cell_ref padded_root() const {
+            cell_ref e = space->empty_cell(level-1);
+            return space->cell_with(
+                    space->cell_with(e, e, e, *root->q.nw),
+                    space->cell_with(e, e, *root->q.ne, e),
+                    space->cell_with(e, *root->q.sw, e, e),
+                    space->cell_with(*root->q.se, e, e, e));
+        }
+
+        // Whether the live cells all lie in the central half of the world.
+        bool has_empty_border() const {
+            cell_ptr e = &space->empty_cell(level-2);
+            cell::quadrants const& nw = root->q.nw->q;
+            cell::quadrants const& ne = root->q.ne->q;
+            cell::quadrants const& sw = root->q.sw->q;
+            cell::quadrants const& se = root->q.se->q;
+            return nw.nw == e && nw.ne == e && nw.sw == e
+                && ne.nw == e && ne.ne == e && ne.se == e
+                && sw.nw == e && sw.sw == e && sw.se == e
+                && se.ne == e && se.sw == e && se.se == e;
+        }
+
+        // Advances the world by 2^exponent generations in a single
+        // evaluation, on the pool if there is one.
+        void evolve(int exponent, task_pool* pool, int cutoff) {
+            // Light travels 2^k cells in 2^k generations; a pattern confined
+            // to the central half of the world is 2^(level-2) cells from the
+            // edge.
+            while(level < std::max(exponent + 2, 5) || !has_empty_border()) grow();
+            cell_ref padded = padded_root();
+            if(pool) {
+                cell_ptr next = nullptr;
+                {
+                    typename basic_cellspace<Rule>::concurrent_scope scope(*space);
+                    pool->execute([&] { next = &padded.parallel_result(*space, level+1, exponent, cutoff); });
+                }
+                replace_root(*next);
+            } else {
+                replace_root(padded.result(*space, level+1, exponent));
+            }
+            if(exponent < 64) generation += std::uint64_t(1) << exponent;
+        }
+
+        // Doubles the sides of the world around the same centre.
+        void grow() {
+            cell_ref next = padded_root();
+            space->add_root(next, level+1);
+            space->remove_root(*root, level);
+            root = &next;
+            ++level;
+        }
+
+        bool contains(std::int64_t x, std::int64_t y) const {
+            if(level >= 64) return true;
+            std::int64_t half = std::int64_t(1) << (level-1);
+            return x >= -half && x < half && y >= -half && y < half;
+        }
+
+        // Coordinates offset so that cells of up to 2^63 sides other than
+        // the root are aligned: bit n tells the halves of a cell of level n+1
+        // apart.
+        static std::uint64_t key(std::int64_t c) {
+            return static_cast<std::uint64_t>(c) ^ (std::uint64_t(1) << 63);
+        }
+        static int quadrant_index(int level, std::int64_t x, std::int64_t y) {
+            return static_cast<int>(key(y) >> (level-1) & 1) << 1 | static_cast<int>(key(x) >> (level-1) & 1);
+        }
+        static cell_ptr quadrant(cell_ref c, int i) {
+            cell_ptr q[] = { c.q.nw, c.q.ne, c.q.sw, c.q.se };
+            return q[i];
+        }
+        static int tile_bit(std::int64_t x, std::int64_t y) {
+            return 63 - 8 * static_cast<int>(key(y) & 7) - static_cast<int>(key(x) & 7);
+        }
+
+        // Applies the sorted edits in [first, last) to a cell with sides
+        // 2^level below the root. Cells of 2^64 sides or more only hold
+        // coordinates in their quadrant towards the centre, inward.
+        cell_ref edited(cell_ref c, int level, edit const* first, edit const* last, int inward) const {
+            if(first == last) return c;
+            if(level == 3) {
+                std::uint64_t bits = c.tile;
+                for(; first != last; ++first) {
+                    std::uint64_t mask = std::uint64_t(1) << tile_bit(first->x, first->y);
+                    bits = first->alive? bits | mask : bits & ~mask;
+                }
+                return space->tile_with(bits);
+            }
+            cell_ptr q[] = { c.q.nw, c.q.ne, c.q.sw, c.q.se };
+            if(level >= 64) {
+                q[inward] = &edited(*q[inward], level-1, first, last, inward);
+            } else {
+                std::uint64_t half = std::uint64_t(1) << (level-1);
+                edit const* south = std::partition_point(first, last, [half](edit const& e) { return !(key(e.y) & half); });
+                auto west = [half](edit const& e) { return !(key(e.x) & half); };
+                edit const* bounds[] = {
+                    first, std::partition_point(first, south, west),
+                    south, std::partition_point(south, last, west),
+                    last,
+                };
+                for(int i = 0; i < 4; ++i)
+                    q[i] = &edited(*q[i], level-1, bounds[i], bounds[i+1], inward);
+            }
+            return space->cell_with(*q[0], *q[1], *q[2], *q[3]);
+        }
+
+        // A viewport being rendered, in key coordinates scaled down to
+        // pixels.
+        struct frame {
+            std::uint64_t x, y;
+            int zoom;
+            std::size_t width, height;
+            float* pixels;
+            float scale;
+        };
+
+        // Renders a cell with sides 2^level below the root, with its top-left
+        // corner at the given key coordinates. Those are only meaningful for
+        // cells less than 2^64 across; larger ones go inward.
+        void render(cell_ref c, int level, std::uint64_t x, std::uint64_t y, int inward, frame const& f) const {
+            if(level >= 64) return render(*quadrant(c, inward), level-1, x, y, inward, f);
+            if(&c == &space->empty_cell(level)) return;
+            std::uint64_t last = (std::uint64_t(1) << level) - 1;
+            std::uint64_t left = x >> f.zoom, right = (x + last) >> f.zoom;
+            std::uint64_t top = y >> f.zoom, bottom = (y + last) >> f.zoom;
+            if(right < f.x || (left >= f.x && left - f.x >= f.width)) return;
+            if(bottom < f.y || (top >= f.y && top - f.y >= f.height)) return;
+            if(level <= f.zoom) {
+                f.pixels[(top - f.y) * f.width + (left - f.x)] += c.population(level) * f.scale;
+                return;
+            }
+            if(level == 3) {
+                for(int row = 0; row < 8; ++row) {
+                    unsigned bits = cell::tile_row(c.tile, row);
+                    std::uint64_t py = ((y + row) >> f.zoom) - f.y;
+                    if(!bits || py >= f.height) continue;
+                    for(int col = 0; col < 8; ++col) {
+                        std::uint64_t px = ((x + col) >> f.zoom) - f.x;
+                        if(bits >> (7 - col) & 1 && px < f.width) f.pixels[py * f.width + px] += f.scale;
+                    }
+                }
+                return;
+            }
+            std::uint64_t half = std::uint64_t(1) << (level-1);
+            for(int i = 0; i < 4; ++i)
+                render(*quadrant(c, i), level-1, i & 1? x + half : x, i & 2? y + half : y, inward, f);
+        }
+
+        // Moves the world to a new root, giving the collector a chance to run.
+        void replace_root(cell_ref next) {
+            space->add_root(next, level);
+            space->remove_root(*root, level);
+            root = &next;
+            space->collect_if_needed();
+        }
+
+        std::shared_ptr<basic_cellspace<Rule>> space;
         int level;
-        cell_ref root;
+        cell_ptr root;
+        std::uint64_t generation = 0;
     };
 }
 
@@ -0,0 +1,508 @@
+// Yajna
+//
+// Written in 2015 by Martinho Fernandes <martinho.fernandes@gmail.com>
+//
+// To the extent possible under law, the author(s) have dedicated all copyright and related
+// and neighboring rights to this software to the public domain worldwide. This software is
+// distributed without any warranty.
+//
+// You should have received a copy of the CC0 Public Domain Dedication along with this software.
+// If not, see <http://creativecommons.org/publicdomain/zero/1.0/>
+
+// Pattern file formats: run-length encoded (RLE) and macrocell (.mc)
+
+#ifndef HLIFE_PATTERNS_HPP
+#define HLIFE_PATTERNS_HPP
+
+#include <hlife/hlife.h++>
+
+#include <algorithm>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <cassert>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+
+namespace hlife {
+    // Thrown when a pattern file cannot be parsed.
+    struct pattern_error : std::runtime_error {
+        explicit pattern_error(std::string const& what) : std::runtime_error(what) {}
+    };
+
+    // Loaders and savers for pattern files. Input is read as a stream, and
+    // cells are built bottom-up straight into the cellspace; no dense grid of
+    // the pattern is ever materialised. Loaders reject patterns declared for
+    // a rule other than that of the cellspace, and files that declare none
+    // are taken to be for Life, B3/S23. Saved files declare the rule of the
+    // cellspace.
+    struct patterns {
+    public:
+        // Loads an RLE pattern into the smallest world, of at least 2^4 sides,
+        // that holds it with its top-left corner at the world's.
+        template <typename Rule>
+        static basic_world<Rule> load_rle(std::istream& in, std::shared_ptr<basic_cellspace<Rule>> space) {
+            // Live cells are gathered one band of eight rows at a time into
+            // the band's non-empty tiles, by x in tiles, each row merged into
+            // them as it ends. Each finished band becomes a strip of tiles
+            // straight away, which is merged with the others into larger
+            // cells as they pair up.
+            strip_builder<Rule> builder(*space);
+            std::vector<std::pair<std::uint64_t, std::uint64_t>> band, row, merged;
+            std::uint64_t x = 0, y = 0;
+            auto end_row = [&] {
+                merged.clear();
+                auto b = band.begin(), r = row.begin();
+                while(b != band.end() && r != row.end()) {
+                    if(b->first < r->first) {
+                        merged.push_back(*b++);
+                    } else if(r->first < b->first) {
+                        merged.push_back(*r++);
+                    } else {
+                        merged.emplace_back(b->first, b->second | r->second);
+                        ++b, ++r;
+                    }
+                }
+                merged.insert(merged.end(), b, band.end());
+                merged.insert(merged.end(), r, row.end());
+                band.swap(merged);
+                row.clear();
+            };
+            auto flush = [&] {
+                end_row();
+                if(band.empty()) return;
+                strip tiles;
+                for(auto const& t : band) tiles.emplace_back(t.first, &space->tile_with(t.second));
+                builder.add(y / 8, std::move(tiles));
+                band.clear();
+            };
+            auto newlines = [&](std::uint64_t n) {
+                end_row();
+                x = 0;
+                std::uint64_t next = extended(y, n);
+                if(next / 8 != y / 8) flush();
+                y = next;
+            };
+            auto live = [&](std::uint64_t n) {
+                // Runs are split at tile boundaries and set a row of a tile at once.
+                std::uint64_t end = extended(x, n);
+                while(x != end) {
+                    std::uint64_t tx = x / 8;
+                    int from = static_cast<int>(x % 8);
+                    int to = end / 8 == tx? static_cast<int>(end % 8) : 8;
+                    std::uint64_t bits = (0xffu >> from) & ~(0xffu >> to) & 0xffu;
+                    bits <<= 56 - (y % 8) * 8;
+                    if(!row.empty() && row.back().first == tx) row.back().second |= bits;
+                    else row.emplace_back(tx, bits);
+                    x += static_cast<std::uint64_t>(to - from);
+                }
+            };
+
+            std::uint64_t count = 0;
+            bool header = false;
+            bool done = false;
+            std::string line;
+            while(!done && std::getline(in, line)) {
+                if(line.empty() || line[0] == '#') continue;
+                if(!header && line.find('=') != std::string::npos) {
+                    // The header is a list of fields such as x = 3, y = 3,
+                    // rule = B3/S23.
+                    std::istringstream fields(line);
+                    std::string field, rule = life_rule;
+                    while(std::getline(fields, field, ',')) {
+                        std::size_t equals = field.find('=');
+                        if(equals == std::string::npos) throw pattern_error("malformed RLE header: " + line);
+                        if(trimmed(field.substr(0, equals)) == "rule") rule = field.substr(equals + 1);
+                    }
+                    check_rule<Rule>(rule);
+                    header = true;
+                    continue;
+                }
+                if(!header) check_rule<Rule>(life_rule);
+                header = true;
+                for(char c : line) {
+                    if(c >= '0' && c <= '9') {
+                        if(count > (max_extent - (c - '0')) / 10) throw pattern_error("RLE run too long");
+                        count = count * 10 + (c - '0');
+                        continue;
+                    }
+                    std::uint64_t n = count? count : 1;
+                    count = 0;
+                    if(c == 'b' || c == '.') {
+                        x = extended(x, n);
+                    } else if(c == '$') {
+                        newlines(n);
+                    } else if(c == '!') {
+                        done = true;
+                        break;
+                    } else if(c == 'o' || (c >= 'A' && c <= 'X')) {
+                        live(n);
+                    } else if(c != ' ' && c != '\t' && c != '\r') {
+                        throw pattern_error(std::string("unexpected character in RLE: ") + c);
+                    }
+                }
+            }
+            flush();
+
+            int level = builder.level();
+            return basic_world<Rule>(std::move(space), builder.finish(level), level);
+        }
+
+        // Saves a world as an RLE pattern covering the whole world. Rows are
+        // produced top to bottom from horizontal strips of cells, dropping
+        // empty cells so that empty regions cost nothing.
+        template <typename Rule>
+        static void save_rle(std::ostream& out, basic_world<Rule> const& w) {
+            assert(w.level < 64);
+            std::uint64_t side = std::uint64_t(1) << w.level;
+            out << "x = " << side << ", y = " << side << ", rule = " << Rule::name() << "\n";
+            rle_writer writer(out);
+            strip s;
+            if(&*w.root != &w.space->empty_cell(w.level)) s.emplace_back(0, w.root);
+            write_strip(writer, *w.space, s, w.level);
+            writer.finish();
+        }
+
+        // Loads a macrocell pattern. The world has the size of the root node,
+        // or 2^4 sides if the file only holds a single tile.
+        template <typename Rule>
+        static basic_world<Rule> load_macrocell(std::istream& in, std::shared_ptr<basic_cellspace<Rule>> space) {
+            // Nodes are numbered from 1 in the order they appear; 0 stands
+            // for the empty cell of the appropriate level.
+            std::vector<std::pair<cell_ptr, int>> nodes(1, std::pair<cell_ptr, int>(nullptr, 0));
+            std::string line;
+            if(!std::getline(in, line) || line.compare(0, 4, "[M2]") != 0)
+                throw pattern_error("not a macrocell file");
+            bool ruled = false;
+            while(std::getline(in, line)) {
+                if(line.compare(0, 2, "#R") == 0) {
+                    check_rule<Rule>(line.substr(2));
+                    ruled = true;
+                    continue;
+                }
+                if(line.empty() || line[0] == '#' || line[0] == '\r') continue;
+                if(!ruled) check_rule<Rule>(life_rule);
+                ruled = true;
+                if(line[0] == '.' || line[0] == '*' || line[0] == '$') {
+                    std::uint64_t bits = 0;
+                    int x = 0, y = 0;
+                    for(char c : line) {
+                        if(c == '$') {
+                            x = 0;
+                            ++y;
+                        } else if(c == '.' || c == '*') {
+                            if(x >= 8 || y >= 8) throw pattern_error("tile out of bounds");
+                            if(c == '*') bits |= std::uint64_t(1) << (63 - y * 8 - x);
+                            ++x;
+                        }
+                    }
+                    nodes.emplace_back(&space->tile_with(bits), 3);
+                    continue;
+                }
+                int level;
+                std::size_t quadrants[4];
+                std::istringstream fields(line);
+                if(!(fields >> level >> quadrants[0] >> quadrants[1] >> quadrants[2] >> quadrants[3]))
+                    throw pattern_error("malformed macrocell node: " + line);
+                if(level <= 3) throw pattern_error("macrocell levels below 4 are not supported");
+                cell_ptr q[4];
+                for(int i = 0; i < 4; ++i) {
+                    if(quadrants[i] >= nodes.size()) throw pattern_error("macrocell node refers ahead");
+                    if(quadrants[i] == 0) {
+                        q[i] = &space->empty_cell(level-1);
+                    } else {
+                        if(nodes[quadrants[i]].second != level-1) throw pattern_error("macrocell node has quadrants of the wrong size");
+                        q[i] = nodes[quadrants[i]].first;
+                    }
+                }
+                nodes.emplace_back(&space->cell_with(*q[0], *q[1], *q[2], *q[3]), level);
+            }
+            if(nodes.size() == 1) throw pattern_error("empty macrocell file");
+
+            cell_ptr root = nodes.back().first;
+            int level = nodes.back().second;
+            if(level == 3) {
+                cell_ref e = space->empty_cell(3);
+                root = &space->cell_with(*root, e, e, e);
+                level = 4;
+            }
+            return basic_world<Rule>(std::move(space), *root, level);
+        }
+
+        // Saves a world as a macrocell pattern. The DAG is walked once and
+        // each unique cell is written a single time, before its parents.
+        template <typename Rule>
+        static void save_macrocell(std::ostream& out, basic_world<Rule> const& w) {
+            out << "[M2] (yajna)\n#R " << Rule::name() << "\n";
+            std::unordered_map<cell_ptr, std::size_t> numbers;
+            std::size_t next = 1;
+            if(write_node(out, *w.space, *w.root, w.level, numbers, next) == 0) {
+                // An empty world still needs a root node.
+                out << w.level << " 0 0 0 0\n";
+            }
+        }
+
+    private:
+        // The rule of files that declare none.
+        static constexpr char const* life_rule = "B3/S23";
+
+        // Checks that a pattern declared for the given rule can be loaded
+        // into a cellspace of the Rule. Rules are declared in B/S notation,
+        // in any case and with the digits in any order, or in the older S/B
+        // notation without letters, such as 23/3 for Life.
+        template <typename Rule>
+        static void check_rule(std::string const& declared) {
+            std::string rule = trimmed(declared);
+            std::size_t slash = rule.find('/');
+            std::string birth, survival;
+            bool valid = slash != std::string::npos;
+            if(valid) {
+                std::string first = rule.substr(0, slash), second = rule.substr(slash + 1);
+                auto letter = [](std::string const& part) {
+                    return part.empty()? '\0' : static_cast<char>(std::toupper(static_cast<unsigned char>(part[0])));
+                };
+                if(letter(first) == 'B' && letter(second) == 'S') {
+                    birth = first.substr(1);
+                    survival = second.substr(1);
+                } else if(letter(first) == 'S' && letter(second) == 'B') {
+                    survival = first.substr(1);
+                    birth = second.substr(1);
+                } else {
+                    survival = first;
+                    birth = second;
+                }
+                auto counts = [](std::string& digits) {
+                    std::sort(digits.begin(), digits.end());
+                    return std::all_of(digits.begin(), digits.end(), [](char c) { return c >= '0' && c <= '8'; })
+                        && std::adjacent_find(digits.begin(), digits.end()) == digits.end();
+                };
+                valid = counts(birth) && counts(survival);
+            }
+            if(!valid) throw pattern_error("malformed rule: " + rule);
+            if("B" + birth + "/S" + survival != Rule::name())
+                throw pattern_error("pattern is for rule " + rule + ", not " + Rule::name());
+        }
+
+        // The string without leading and trailing whitespace.
+        static std::string trimmed(std::string const& text) {
+            std::size_t first = text.find_first_not_of(" \t\r");
+            if(first == std::string::npos) return std::string();
+            return text.substr(first, text.find_last_not_of(" \t\r") - first + 1);
+        }
+
+        // Patterns are limited to 2^62 cells across, so that they fit in a
+        // world.
+        static constexpr std::uint64_t max_extent = std::uint64_t(1) << 62;
+
+        // Moves a coordinate of an RLE pattern n cells further.
+        static std::uint64_t extended(std::uint64_t coordinate, std::uint64_t n) {
+            if(n > max_extent - coordinate) throw pattern_error("RLE pattern too large");
+            return coordinate + n;
+        }
+
+        // Writes RLE runs, merging consecutive runs of the same kind and
+        // dropping dead cells at the end of rows and empty rows at the end.
+        struct rle_writer {
+            explicit rle_writer(std::ostream& out) : out(out) {}
+
+            void run(char tag, std::uint64_t n) {
+                if(n == 0) return;
+                if(tag == '$' && pending == 'b') pending_count = 0, pending = 0;
+                if(tag == pending) {
+                    pending_count += n;
+                    return;
+                }
+                emit();
+                pending = tag;
+                pending_count = n;
+            }
+            void finish() {
+                // Dead cells and empty rows at the end go unwritten.
+                if(pending == 'o') emit();
+                out << "!\n";
+            }
+
+        private:
+            void emit() {
+                if(pending == 0 || pending_count == 0) return;
+                std::string item = pending_count > 1? std::to_string(pending_count) : std::string();
+                item += pending;
+                if(width + item.size() > 70) {
+                    out << '\n';
+                    width = 0;
+                }
+                out << item;
+                width += item.size();
+            }
+
+            std::ostream& out;
+            char pending = 0;
+            std::uint64_t pending_count = 0;
+            std::size_t width = 0;
+        };
+
+        // A horizontal strip of cells of the same level, with the x
+        // coordinate of each (in cells), from west to east.
+        using strip = std::vector<std::pair<std::uint64_t, cell_ptr>>;
+
+        // Builds a cell from the strips of tiles of consecutive bands, from
+        // north to south; this is write_strip() in reverse. Whenever two
+        // strips of the same level are there they are merged into a strip
+        // of the next level, so at most one strip per level is pending and
+        // only non-empty cells are kept.
+        template <typename Rule>
+        struct strip_builder {
+        public:
+            explicit strip_builder(basic_cellspace<Rule>& space) : space(space) {}
+
+            // Adds the strip of tiles of the given band. Bands are added in
+            // order, and those skipped are empty.
+            void add(std::uint64_t band, strip tiles) {
+                add_empty(band - bands);
+                if(!tiles.empty()) width = std::max(width, tiles.back().first + 1);
+                push(std::move(tiles), 3);
+                ++bands;
+            }
+
+            // The level of the smallest cell, of at least 2^4 sides, that
+            // holds the bands added so far.
+            int level() const {
+                int level = 4;
+                while((std::uint64_t(1) << (level - 3)) < std::max(width, bands)) ++level;
+                return level;
+            }
+
+            // The cell of the given level, no smaller than level(), with the
+            // bands at its top-left corner.
+            cell_ref finish(int level) {
+                add_empty((std::uint64_t(1) << (level - 3)) - bands);
+                strip const& top = pending[level - 3].second;
+                return top.empty()? space.empty_cell(level) : *top.front().second;
+            }
+
+        private:
+            // Adds a run of empty bands, as a few empty strips as large as the
+            // bands already there allow.
+            void add_empty(std::uint64_t n) {
+                while(n != 0) {
+                    int k = 0;
+                    while(!(bands >> k & 1) && (std::uint64_t(2) << k) <= n) ++k;
+                    push(strip(), k + 3);
+                    bands += std::uint64_t(1) << k;
+                    n -= std::uint64_t(1) << k;
+                }
+            }
+
+            // Adds a strip of the given level south of those there, carrying
+            // merges upwards.
+            void push(strip cells, int level) {
+                for(;; ++level) {
+                    std::size_t i = static_cast<std::size_t>(level - 3);
+                    if(pending.size() <= i) pending.resize(i + 1);
+                    if(!pending[i].first) {
+                        pending[i] = std::make_pair(true, std::move(cells));
+                        return;
+                    }
+                    cells = merge(pending[i].second, cells, level);
+                    pending[i].first = false;
+                    pending[i].second.clear();
+                }
+            }
+
+            // Pairs the cells of two strips of the given level, north over
+            // south, into the cells of a strip of the next level.
+            strip merge(strip const& north, strip const& south, int level) const {
+                cell_ptr empty = &space.empty_cell(level);
+                strip merged;
+                auto n = north.begin(), s = south.begin();
+                while(n != north.end() || s != south.end()) {
+                    std::uint64_t x = std::min(n != north.end()? n->first >> 1 : ~std::uint64_t(0),
+                                               s != south.end()? s->first >> 1 : ~std::uint64_t(0));
+                    cell_ptr q[] = { empty, empty, empty, empty };
+                    for(; n != north.end() && n->first >> 1 == x; ++n) q[n->first & 1] = n->second;
+                    for(; s != south.end() && s->first >> 1 == x; ++s) q[2 + (s->first & 1)] = s->second;
+                    merged.emplace_back(x, &space.cell_with(*q[0], *q[1], *q[2], *q[3]));
+                }
+                return merged;
+            }
+
+            basic_cellspace<Rule>& space;
+            // The pending strip of each level, from tiles up, if any.
+            std::vector<std::pair<bool, strip>> pending;
+            std::uint64_t bands = 0;
+            // The width of the bands, in tiles.
+            std::uint64_t width = 0;
+        };
+
+        // Writes the rows of a strip, recursing into the northern and then
+        // the southern halves of its cells.
+        template <typename Rule>
+        static void write_strip(rle_writer& writer, basic_cellspace<Rule> const& space, strip const& cells, int level) {
+            if(cells.empty()) {
+                writer.run('$', std::uint64_t(1) << level);
+                return;
+            }
+            if(level == 3) {
+                for(int y = 0; y < 8; ++y) {
+                    std::uint64_t x = 0;
+                    for(auto const& t : cells) {
+                        unsigned bits = cell::tile_row(t.second->tile, y);
+                        for(int i = 0; i < 8; ++i) {
+                            if(!(bits & (0x80u >> i))) continue;
+                            writer.run('b', t.first * 8 + i - x);
+                            writer.run('o', 1);
+                            x = t.first * 8 + i + 1;
+                        }
+                    }
+                    writer.run('$', 1);
+                }
+                return;
+            }
+            cell_ptr empty = &space.empty_cell(level-1);
+            strip north, south;
+            for(auto const& c : cells) {
+                auto add = [empty](strip& half, std::uint64_t x, cell_ptr q) { if(q != empty) half.emplace_back(x, q); };
+                add(north, 2 * c.first, c.second->q.nw);
+                add(north, 2 * c.first + 1, c.second->q.ne);
+                add(south, 2 * c.first, c.second->q.sw);
+                add(south, 2 * c.first + 1, c.second->q.se);
+            }
+            write_strip(writer, space, north, level-1);
+            write_strip(writer, space, south, level-1);
+        }
+
+        // Writes the cell's subtree and returns the cell's number, or 0 for
+        // empty cells.
+        template <typename Rule>
+        static std::size_t write_node(std::ostream& out, basic_cellspace<Rule> const& space, cell_ref c, int level,
+                                      std::unordered_map<cell_ptr, std::size_t>& numbers, std::size_t& next) {
+            if(&c == &space.empty_cell(level)) return 0;
+            auto it = numbers.find(&c);
+            if(it != numbers.end()) return it->second;
+            if(level == 3) {
+                for(int y = 0; y < 8; ++y) {
+                    unsigned bits = cell::tile_row(c.tile, y);
+                    for(int x = 0; bits & (0xffu >> x); ++x) out << ((bits & (0x80u >> x))? '*' : '.');
+                    out << '$';
+                }
+                out << '\n';
+            } else {
+                std::size_t nw = write_node(out, space, *c.q.nw, level-1, numbers, next);
+                std::size_t ne = write_node(out, space, *c.q.ne, level-1, numbers, next);
+                std::size_t sw = write_node(out, space, *c.q.sw, level-1, numbers, next);
+                std::size_t se = write_node(out, space, *c.q.se, level-1, numbers, next);
+                out << level << ' ' << nw << ' ' << ne << ' ' << sw << ' ' << se << '\n';
+            }
+            return numbers[&c] = next++;
+        }
+    };
+}
+
+#endif // HLIFE_PATTERNS_HPP
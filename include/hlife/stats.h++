@@ -0,0 +1,227 @@
+// Yajna
+//
+// Written in 2015 by Martinho Fernandes <martinho.fernandes@gmail.com>
+//
+// To the extent possible under law, the author(s) have dedicated all copyright and related
+// and neighboring rights to this software to the public domain worldwide. This software is
+// distributed without any warranty.
+//
+// You should have received a copy of the CC0 Public Domain Dedication along with this software.
+// If not, see <http://creativecommons.org/publicdomain/zero/1.0/>
+
+// Instrumentation of hash-consing and memoisation
+
+#ifndef HLIFE_STATS_HPP
+#define HLIFE_STATS_HPP
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace hlife {
+    // Statistics are only collected when HLIFE_STATS is defined. Otherwise
+    // the counting compiles away and the counters read as zero.
+#ifdef HLIFE_STATS
+    constexpr bool stats_enabled = true;
+#else
+    constexpr bool stats_enabled = false;
+#endif
+
+    // Lookups in one of the hash-cons indices of a cellspace.
+    struct index_stats {
+        // Lookups that found an existing cell, and those that created one.
+        std::uint64_t hits = 0;
+        std::uint64_t inserts = 0;
+        // Lookups by the number of slots they probed, from one to seven, with
+        // longer probes counted in the last entry.
+        std::array<std::uint64_t, 8> probe_lengths {{}};
+
+        std::uint64_t lookups() const { return hits + inserts; }
+        double mean_probe_length() const {
+            std::uint64_t total = 0;
+            for(std::size_t i = 0; i < probe_lengths.size(); ++i) total += (i + 1) * probe_lengths[i];
+            return lookups()? double(total) / lookups() : 0;
+        }
+    };
+
+    // Evaluations of cells of one level.
+    struct level_stats {
+        // Results computed, and those found memoised as a cell's future.
+        std::uint64_t results = 0;
+        std::uint64_t result_hits = 0;
+        // Results of smaller steps computed, and those found memoised.
+        std::uint64_t steps = 0;
+        std::uint64_t step_hits = 0;
+    };
+
+    // A snapshot of the activity of a cellspace.
+    struct cellspace_stats {
+        index_stats nodes;
+        index_stats tiles;
+        // Evaluations by level. The last entry gathers all the levels from
+        // there up.
+        std::vector<level_stats> levels;
+        // The footprint of the cellspace when the snapshot was taken.
+        std::size_t cells = 0;
+        std::size_t memory_in_use = 0;
+
+        // The fraction of evaluations answered from memoised results.
+        double memo_hit_rate() const {
+            std::uint64_t hits = 0, total = 0;
+            for(auto const& l : levels) {
+                hits += l.result_hits + l.step_hits;
+                total += l.result_hits + l.step_hits + l.results + l.steps;
+            }
+            return total? double(hits) / total : 0;
+        }
+        double bytes_per_cell() const {
+            return cells? double(memory_in_use) / cells : 0;
+        }
+    };
+
+    // Counters of the activity of a cellspace. Each thread counts into its
+    // own block, so counting takes no locks and shares no cache lines. A
+    // block is only ever written by its thread: counters are atomic only so
+    // that snapshots can read them meanwhile, and are incremented with
+    // plain loads and stores.
+    struct stats_counters {
+    public:
+        static constexpr int max_level = 64;
+
+        stats_counters() = default;
+        stats_counters(stats_counters const&) = delete;
+        stats_counters& operator=(stats_counters const&) = delete;
+
+        void count_lookup(bool tile, bool inserted, std::size_t probes) const {
+            if(!stats_enabled) return;
+            block& b = local();
+            index& i = tile? b.tiles : b.nodes;
+            increment(inserted? i.inserts : i.hits);
+            increment(i.probe_lengths[std::min<std::size_t>(probes, 8) - 1]);
+        }
+        void count_result(int level, bool hit) const {
+            if(!stats_enabled) return;
+            level_counters& l = local().levels[std::min(level, int(max_level))];
+            increment(hit? l.result_hits : l.results);
+        }
+        void count_step(int level, bool hit) const {
+            if(!stats_enabled) return;
+            level_counters& l = local().levels[std::min(level, int(max_level))];
+            increment(hit? l.step_hits : l.steps);
+        }
+
+        // The counts of all threads so far, including those that are gone.
+        cellspace_stats total() const {
+            cellspace_stats s;
+            s.levels.resize(max_level + 1);
+            std::lock_guard<std::mutex> lock(mutex);
+            for(auto const& b : blocks) b.second->add_to(s);
+            return s;
+        }
+
+    private:
+        struct index {
+            std::atomic<std::uint64_t> hits { 0 };
+            std::atomic<std::uint64_t> inserts { 0 };
+            std::atomic<std::uint64_t> probe_lengths[8] {};
+        };
+        struct level_counters {
+            std::atomic<std::uint64_t> results { 0 };
+            std::atomic<std::uint64_t> result_hits { 0 };
+            std::atomic<std::uint64_t> steps { 0 };
+            std::atomic<std::uint64_t> step_hits { 0 };
+        };
+        struct block {
+            index nodes;
+            index tiles;
+            level_counters levels[max_level + 1];
+
+            void add_to(cellspace_stats& s) const {
+                add_to(s.nodes, nodes);
+                add_to(s.tiles, tiles);
+                for(int i = 0; i <= max_level; ++i) {
+                    s.levels[i].results += levels[i].results.load(std::memory_order_relaxed);
+                    s.levels[i].result_hits += levels[i].result_hits.load(std::memory_order_relaxed);
+                    s.levels[i].steps += levels[i].steps.load(std::memory_order_relaxed);
+                    s.levels[i].step_hits += levels[i].step_hits.load(std::memory_order_relaxed);
+                }
+            }
+            static void add_to(index_stats& s, index const& i) {
+                s.hits += i.hits.load(std::memory_order_relaxed);
+                s.inserts += i.inserts.load(std::memory_order_relaxed);
+                for(std::size_t n = 0; n < s.probe_lengths.size(); ++n)
+                    s.probe_lengths[n] += i.probe_lengths[n].load(std::memory_order_relaxed);
+            }
+        };
+
+        // The block of the calling thread. Blocks belong to the counters,
+        // and each thread caches those of the last few counters it used. The
+        // cache is keyed by an id that is never reused, so that entries of
+        // counters that are gone never match.
+        static constexpr std::size_t cache_size = 4;
+        block& local() const {
+            struct entry {
+                std::uint64_t id;
+                block* counts;
+            };
+            static thread_local entry cache[cache_size] = {};
+            static thread_local std::size_t next = 0;
+            for(auto const& e : cache)
+                if(e.id == id) return *e.counts;
+            block& b = find_or_add(std::this_thread::get_id());
+            cache[next] = entry{ id, &b };
+            next = (next + 1) % cache_size;
+            return b;
+        }
+        block& find_or_add(std::thread::id thread) const {
+            std::lock_guard<std::mutex> lock(mutex);
+            for(auto const& b : blocks)
+                if(b.first == thread) return *b.second;
+            blocks.emplace_back(thread, std::unique_ptr<block>(new block()));
+            return *blocks.back().second;
+        }
+
+        static std::uint64_t unique_id() {
+            static std::atomic<std::uint64_t> next { 1 };
+            return next.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        static void increment(std::atomic<std::uint64_t>& counter) {
+            counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+
+        std::uint64_t const id = unique_id();
+        mutable std::mutex mutex;
+        // The block of each thread that counted. A thread that ends leaves
+        // its block to the next one with the same id.
+        mutable std::vector<std::pair<std::thread::id, std::unique_ptr<block>>> blocks;
+    };
+
+    // The activity between two snapshots of the counters. The footprint is
+    // that of the later one.
+    inline cellspace_stats operator-(cellspace_stats later, cellspace_stats const& earlier) {
+        auto subtract = [](index_stats& a, index_stats const& b) {
+            a.hits -= b.hits;
+            a.inserts -= b.inserts;
+            for(std::size_t n = 0; n < a.probe_lengths.size(); ++n) a.probe_lengths[n] -= b.probe_lengths[n];
+        };
+        subtract(later.nodes, earlier.nodes);
+        subtract(later.tiles, earlier.tiles);
+        for(std::size_t i = 0; i < later.levels.size() && i < earlier.levels.size(); ++i) {
+            later.levels[i].results -= earlier.levels[i].results;
+            later.levels[i].result_hits -= earlier.levels[i].result_hits;
+            later.levels[i].steps -= earlier.levels[i].steps;
+            later.levels[i].step_hits -= earlier.levels[i].step_hits;
+        }
+        return later;
+    }
+}
+
+#endif // HLIFE_STATS_HPP
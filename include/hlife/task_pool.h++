@@ -0,0 +1,259 @@
+// Yajna
+//
+// Written in 2015 by Martinho Fernandes <martinho.fernandes@gmail.com>
+//
+// To the extent possible under law, the author(s) have dedicated all copyright and related
+// and neighboring rights to this software to the public domain worldwide. This software is
+// distributed without any warranty.
+//
+// You should have received a copy of the CC0 Public Domain Dedication along with this software.
+// If not, see <http://creativecommons.org/publicdomain/zero/1.0/>
+
+// Work-stealing task pool for fork-join parallelism
+
+#ifndef HLIFE_TASK_POOL_HPP
+#define HLIFE_TASK_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <cassert>
+#include <cstddef>
+
+namespace hlife {
+    struct task_group;
+
+    // A pool of workers, each with its own deque of tasks. Workers pop tasks
+    // from the back of their own deque and steal from the front of the others'
+    // when they run out, and sleep when there is nothing to steal for a
+    // while. The thread that calls execute() acts as worker 0 for the
+    // duration of the call; the other workers are dedicated threads.
+    struct task_pool {
+    public:
+        // Creates a pool with the given number of workers, including the
+        // calling thread.
+        explicit task_pool(unsigned workers)
+        : queues(workers? workers : 1) {
+            for(unsigned i = 1; i < queues.size(); ++i)
+                threads.emplace_back([this, i] { work(i); });
+        }
+
+        ~task_pool() {
+            {
+                std::lock_guard<std::mutex> lock(sleep_mutex);
+                done = true;
+            }
+            wake.notify_all();
+            for(auto& t : threads) t.join();
+        }
+
+        task_pool(task_pool const&) = delete;
+        task_pool& operator=(task_pool const&) = delete;
+
+        unsigned size() const { return static_cast<unsigned>(queues.size()); }
+
+        // Runs the function on the calling thread with the rest of the pool
+        // available to steal the tasks it forks. Only one thread may be
+        // executing at a time. Exceptions thrown by the function propagate.
+        template <typename Fun>
+        void execute(Fun&& fun) {
+            execution scope(*this);
+            fun();
+        }
+
+    private:
+        friend struct task_group;
+
+        struct task {
+            std::function<void()> fun;
+            task_group* group;
+        };
+
+        // Makes the calling thread worker 0 of the pool for as long as it
+        // lives, however the execution ends.
+        struct execution {
+        public:
+            explicit execution(task_pool& pool) {
+                assert(current() == nullptr);
+                current() = &pool;
+                index() = 0;
+            }
+            ~execution() { current() = nullptr; }
+
+            execution(execution const&) = delete;
+            execution& operator=(execution const&) = delete;
+        };
+
+        // Workers look for tasks this many times before going to sleep.
+        static constexpr int spins_before_sleep = 64;
+
+        struct queue {
+            std::mutex mutex;
+            std::deque<task> tasks;
+        };
+
+        // The pool and worker index of the calling thread, if it is a worker.
+        static task_pool*& current() {
+            static thread_local task_pool* pool = nullptr;
+            return pool;
+        }
+        static unsigned& index() {
+            static thread_local unsigned i = 0;
+            return i;
+        }
+
+        // Adds a task to the calling worker's deque, waking a sleeping
+        // worker to steal it. The count of queued tasks is raised before
+        // the sleepers are checked, and sleepers check it after saying they
+        // sleep, so no wake-up is lost.
+        void push(task t) {
+            {
+                queue& q = queues[index()];
+                std::lock_guard<std::mutex> lock(q.mutex);
+                q.tasks.push_back(std::move(t));
+            }
+            queued.fetch_add(1);
+            if(sleepers.load() == 0) return;
+            {
+                std::lock_guard<std::mutex> lock(sleep_mutex);
+            }
+            wake.notify_one();
+        }
+
+        // Takes a task from the calling worker's own deque, or steals one
+        // from another worker.
+        bool pop(task& t) {
+            unsigned self = index();
+            for(unsigned n = 0; n < queues.size(); ++n) {
+                unsigned i = (self + n) % queues.size();
+                queue& q = queues[i];
+                std::lock_guard<std::mutex> lock(q.mutex);
+                if(q.tasks.empty()) continue;
+                if(i == self) {
+                    t = std::move(q.tasks.back());
+                    q.tasks.pop_back();
+                } else {
+                    t = std::move(q.tasks.front());
+                    q.tasks.pop_front();
+                }
+                queued.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+            return false;
+        }
+
+        static void run(task& t);
+
+        void work(unsigned i) {
+            current() = this;
+            index() = i;
+            for(int idle = 0;;) {
+                task t;
+                if(pop(t)) {
+                    run(t);
+                    idle = 0;
+                    continue;
+                }
+                if(++idle < spins_before_sleep) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                idle = 0;
+                std::unique_lock<std::mutex> lock(sleep_mutex);
+                sleepers.fetch_add(1);
+                wake.wait(lock, [this] { return done || queued.load() != 0; });
+                sleepers.fetch_sub(1);
+                if(done) return;
+            }
+        }
+
+        std::vector<queue> queues;
+        std::vector<std::thread> threads;
+        std::atomic<std::size_t> queued { 0 };
+        std::atomic<unsigned> sleepers { 0 };
+        bool done = false;
+        std::mutex sleep_mutex;
+        std::condition_variable wake;
+    };
+
+    // A set of tasks forked together and joined with wait(). The waiting
+    // thread runs pending tasks, its own or stolen, until the group is done.
+    // Outside of task_pool::execute tasks simply run inline. The first
+    // exception thrown by a task is rethrown by wait(), and the tasks of the
+    // group that have not started by then are skipped.
+    struct task_group {
+    public:
+        task_group() : pool(task_pool::current()) {}
+        // Joins the tasks still running, dropping any exception they threw
+        // if wait() was not called.
+        ~task_group() { join(); }
+
+        task_group(task_group const&) = delete;
+        task_group& operator=(task_group const&) = delete;
+
+        template <typename Fun>
+        void run(Fun&& fun) {
+            if(!pool) {
+                fun();
+                return;
+            }
+            task_pool::task t{ std::forward<Fun>(fun), this };
+            pending.fetch_add(1, std::memory_order_relaxed);
+            try {
+                pool->push(std::move(t));
+            } catch(...) {
+                pending.fetch_sub(1, std::memory_order_relaxed);
+                throw;
+            }
+        }
+
+        void wait() {
+            join();
+            if(!error) return;
+            std::exception_ptr e = error;
+            error = nullptr;
+            std::rethrow_exception(e);
+        }
+
+    private:
+        friend struct task_pool;
+
+        void join() {
+            while(pending.load(std::memory_order_acquire) != 0) {
+                task_pool::task t;
+                if(pool->pop(t)) task_pool::run(t);
+                else std::this_thread::yield();
+            }
+        }
+
+        // Runs one of the group's tasks on whichever worker took it.
+        void finish(std::function<void()>& fun) {
+            if(!failed.load(std::memory_order_relaxed)) {
+                try {
+                    fun();
+                } catch(...) {
+                    if(!failed.exchange(true, std::memory_order_relaxed)) error = std::current_exception();
+                }
+            }
+            pending.fetch_sub(1, std::memory_order_release);
+        }
+
+        task_pool* pool;
+        std::atomic<std::size_t> pending { 0 };
+        std::atomic<bool> failed { false };
+        std::exception_ptr error;
+    };
+
+    inline void task_pool::run(task& t) {
+        t.group->finish(t.fun);
+    }
+}
+
+#endif // HLIFE_TASK_POOL_HPP
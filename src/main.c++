@@ -1,10 +1,464 @@
 #define NONIUS_RUNNER
 #include <nonius.h++>
+#include <algorithm>
+#include <atomic>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <cstddef>
+#include <cstdlib>
 #define private public
 #include <hlife/hlife.h++>
+#include <hlife/patterns.h++>
 
-NONIUS_BENCHMARK("generate-16384", []{
-    auto space = std::make_shared<hlife::cellspace>();
-    hlife::world w(space, 16384);
-    w.root.result(*space, 16383);
+#ifdef YAJNA_TRACK_HEAP
+namespace {
+    // The heap usage of the program, tracked by the replacements of the
+    // global allocation functions below while a benchmark asks for it. This
+    // catches the temporaries of the code under test along with the
+    // cellspace. The replacements slow down every allocation, so they are
+    // only built into bin/yajna-heap, and the timings of that build are not
+    // comparable with those of bin/yajna.
+    struct heap_tracker {
+        std::atomic<bool> tracking { false };
+        std::atomic<std::ptrdiff_t> current { 0 };
+        std::atomic<std::ptrdiff_t> peak { 0 };
+
+        void allocated(std::size_t size) {
+            if(!tracking.load(std::memory_order_relaxed)) return;
+            std::ptrdiff_t now = current.fetch_add(size, std::memory_order_relaxed) + size;
+            std::ptrdiff_t high = peak.load(std::memory_order_relaxed);
+            while(now > high && !peak.compare_exchange_weak(high, now, std::memory_order_relaxed)) {}
+        }
+        void freed(std::size_t size) {
+            if(tracking.load(std::memory_order_relaxed)) current.fetch_sub(size, std::memory_order_relaxed);
+        }
+    };
+    heap_tracker heap;
+
+    // Each block is prefixed with its size, in a header that keeps the
+    // block aligned.
+    constexpr std::size_t heap_header = alignof(std::max_align_t);
+}
+
+// Not inlined: once inlined, GCC checks the header arithmetic against the
+// object being deleted and warns about it.
+#ifdef __GNUC__
+__attribute__((noinline))
+#endif
+void* operator new(std::size_t size) {
+    void* block = std::malloc(size + heap_header);
+    if(!block) throw std::bad_alloc();
+    *static_cast<std::size_t*>(block) = size;
+    heap.allocated(size);
+    return static_cast<char*>(block) + heap_header;
+}
+#ifdef __GNUC__
+__attribute__((noinline))
+#endif
+void operator delete(void* p) noexcept {
+    if(!p) return;
+    void* block = static_cast<char*>(p) - heap_header;
+    heap.freed(*static_cast<std::size_t*>(block));
+    std::free(block);
+}
+#endif
+
+namespace {
+    // The statistics of the cellspace of the latest run of the current
+    // benchmark, if it recorded any.
+    struct recorded_stats {
+        bool recorded = false;
+        hlife::cellspace_stats stats;
+        // The cells reachable in the cellspace, by level. This walks them
+        // all, so it is only done in builds with HLIFE_STATS.
+        std::vector<std::size_t> cells_per_level;
+        // The generations the run advanced, if it evolved a world.
+        std::uint64_t generations = 0;
+        // The peak heap usage of the run, if it was tracked.
+        bool heap_recorded = false;
+        std::size_t peak_heap = 0;
+        // A caveat on the timings, if any.
+        std::string note;
+    };
+    recorded_stats& latest_stats() {
+        static recorded_stats latest;
+        return latest;
+    }
+
+    // Records the statistics of a cellspace after a benchmark run, along
+    // with the generations the run advanced.
+    template <typename Rule>
+    void record_stats(hlife::basic_cellspace<Rule> const& space, std::uint64_t generations = 0) {
+        latest_stats().stats = space.stats();
+        latest_stats().generations = generations;
+        if(hlife::stats_enabled) latest_stats().cells_per_level = space.cells_per_level();
+        latest_stats().recorded = true;
+    }
+    template <typename Rule>
+    void record_stats(std::shared_ptr<hlife::basic_cellspace<Rule>> const& space) {
+        record_stats(*space);
+    }
+    template <typename Rule>
+    void record_stats(hlife::basic_world<Rule> const& w) {
+        record_stats(*w.space, w.current_generation());
+    }
+
+    // Measures runs that each build a cellspace or a world. The result of
+    // the last run is kept past the timed region, where its statistics are
+    // recorded, so that walking its cells is not timed.
+    template <typename Run>
+    void measure_recorded(nonius::chronometer meter, Run run) {
+        using result = decltype(run());
+        std::unique_ptr<result> last;
+        meter.measure([&](int i) {
+            if(i + 1 == meter.runs()) last.reset(new result(run()));
+            else run();
+        });
+        record_stats(*last);
+    }
+
+    // Tracks the heap usage from now on, to record its peak at the end of
+    // the run. Both do nothing unless built with YAJNA_TRACK_HEAP.
+    void track_heap() {
+#ifdef YAJNA_TRACK_HEAP
+        heap.current.store(0, std::memory_order_relaxed);
+        heap.peak.store(0, std::memory_order_relaxed);
+        heap.tracking.store(true, std::memory_order_relaxed);
+#endif
+    }
+    void record_peak_heap() {
+#ifdef YAJNA_TRACK_HEAP
+        heap.tracking.store(false, std::memory_order_relaxed);
+        latest_stats().peak_heap = static_cast<std::size_t>(heap.peak.load(std::memory_order_relaxed));
+        latest_stats().heap_recorded = true;
+#endif
+    }
+
+    // HighLife, B36/S23, which has a replicator.
+    using highlife = hlife::rule<1u << 3 | 1u << 6, 1u << 2 | 1u << 3>;
+
+    // Builds a random soup with sides 2^level straight into the cellspace.
+    template <typename Rule>
+    hlife::cell_ref random_cell(hlife::basic_cellspace<Rule>& space, int level, std::mt19937& rng) {
+        if(level == 3) return space.tile_with(std::uint64_t(rng()) << 32 | rng());
+        hlife::cell_ref nw = random_cell(space, level-1, rng);
+        hlife::cell_ref ne = random_cell(space, level-1, rng);
+        hlife::cell_ref sw = random_cell(space, level-1, rng);
+        hlife::cell_ref se = random_cell(space, level-1, rng);
+        return space.cell_with(nw, ne, sw, se);
+    }
+
+    // Builds a world with sides 2^level holding a random soup in its central
+    // quarter.
+    template <typename Rule>
+    hlife::basic_world<Rule> soup_world(std::shared_ptr<hlife::basic_cellspace<Rule>> space, int level, std::mt19937& rng) {
+        hlife::cell_ref e = space->empty_cell(level-2);
+        hlife::cell_ref s = random_cell(*space, level-1, rng);
+        hlife::cell_ref root = space->cell_with(
+                space->cell_with(e, e, e, *s.q.nw),
+                space->cell_with(e, e, *s.q.ne, e),
+                space->cell_with(e, *s.q.sw, e, e),
+                space->cell_with(*s.q.se, e, e, e));
+        return hlife::basic_world<Rule>(std::move(space), root, level);
+    }
+
+    // Measures stepping a soup on a pool with the given number of workers.
+    // Pools with more workers than there are hardware threads are marked, as
+    // their timings are mostly those of the workers taking turns.
+    void step_soup_parallel(nonius::chronometer meter, unsigned workers) {
+        unsigned threads = std::thread::hardware_concurrency();
+        if(threads != 0 && workers > threads) {
+            latest_stats().note = "oversubscribed: " + std::to_string(workers) + " workers on "
+                                + std::to_string(threads) + " hardware threads";
+        }
+        hlife::task_pool pool(workers);
+        measure_recorded(meter, [&pool]{
+            auto space = std::make_shared<hlife::cellspace>();
+            std::mt19937 rng(1024);
+            auto w = soup_world(space, 10, rng);
+            for(int i = 0; i < 4; ++i) w.step(pool);
+            return w;
+        });
+    }
+
+    // Measures advancing a soup, starting in a 512x512 world, by 1024
+    // generations, stride generations at a time.
+    void advance_soup(nonius::chronometer meter, std::uint64_t stride) {
+        measure_recorded(meter, [stride]{
+            auto space = std::make_shared<hlife::cellspace>();
+            std::mt19937 rng(1024);
+            auto w = soup_world(space, 9, rng);
+            for(std::uint64_t g = 0; g < 1024; g += stride) w.advance(stride);
+            return w;
+        });
+    }
+
+    // Saves a soup in a world with sides 2^level, after it has run for the
+    // given number of generations, with the given saver. Each result is
+    // built once and shared.
+    using saver = void (*)(std::ostream&, hlife::world const&);
+    std::string const& saved_soup(int level, std::uint64_t generations, saver save) {
+        static std::map<std::tuple<int, std::uint64_t, saver>, std::string> saved;
+        auto key = std::make_tuple(level, generations, save);
+        auto it = saved.find(key);
+        if(it != saved.end()) return it->second;
+        auto space = std::make_shared<hlife::cellspace>();
+        std::mt19937 rng(2048);
+        auto w = soup_world(space, level, rng);
+        w.advance(generations);
+        std::ostringstream out;
+        save(out, w);
+        return saved[key] = out.str();
+    }
+
+    // Measures loading a saved pattern in the given format, recording the
+    // peak heap usage of the loader and the cellspace it fills in builds
+    // that track it.
+    template <typename Load>
+    void load_pattern(nonius::chronometer meter, std::string const& saved, Load load) {
+        measure_recorded(meter, [&saved, load]{
+            std::istringstream in(saved);
+            track_heap();
+            hlife::world w = load(in, std::make_shared<hlife::cellspace>());
+            record_peak_heap();
+            return w;
+        });
+    }
+    hlife::world load_rle(std::istream& in, std::shared_ptr<hlife::cellspace> space) {
+        return hlife::patterns::load_rle(in, std::move(space));
+    }
+    hlife::world load_macrocell(std::istream& in, std::shared_ptr<hlife::cellspace> space) {
+        return hlife::patterns::load_macrocell(in, std::move(space));
+    }
+    void save_rle(std::ostream& out, hlife::world const& w) { hlife::patterns::save_rle(out, w); }
+    void save_macrocell(std::ostream& out, hlife::world const& w) { hlife::patterns::save_macrocell(out, w); }
+
+    // Measures rendering 1024x768 frames of a soup centred in the viewport,
+    // with each pixel covering 2^zoom x 2^zoom cells.
+    void render_soup(nonius::chronometer meter, int zoom) {
+        auto space = std::make_shared<hlife::cellspace>();
+        std::mt19937 rng(4096);
+        auto w = soup_world(space, 12, rng);
+        w.advance(1024);
+        std::vector<float> pixels(1024 * 768);
+        std::int64_t x = -(std::int64_t(512) << zoom), y = -(std::int64_t(384) << zoom);
+        meter.measure([&]{
+            w.render(x, y, zoom, 1024, 768, pixels.data());
+            return pixels[0];
+        });
+        record_stats(*space);
+    }
+
+    // Random edits spread over a 4096x4096 square.
+    std::vector<hlife::world::edit> random_edits(std::size_t count) {
+        std::mt19937 rng(4096);
+        std::vector<hlife::world::edit> edits(count);
+        for(auto& e : edits) e = hlife::world::edit{ int(rng() % 4096) - 2048, int(rng() % 4096) - 2048, true };
+        return edits;
+    }
+
+    // Reports the mean time of each benchmark along with the statistics its
+    // runs recorded: the footprint of the cellspace, the peak heap usage if
+    // tracked, the generations advanced per second if any and, in builds
+    // with HLIFE_STATS, cells built per second and the memo hit rate,
+    // followed by the lookups of both indices with their probe lengths and,
+    // for each level, the reachable cells and how evaluations went.
+    struct stats_reporter : nonius::reporter {
+    private:
+        std::string description() override {
+            return "timings with cellspace statistics";
+        }
+
+        void do_benchmark_start(std::string const& name) override {
+            report_stream() << "\nbenchmarking " << name << "\n";
+            latest_stats().recorded = false;
+            latest_stats().heap_recorded = false;
+            latest_stats().note.clear();
+        }
+        void do_measurement_complete(std::vector<nonius::fp_seconds> const& samples) override {
+            mean = nonius::fp_seconds(0);
+            for(auto s : samples) mean += s;
+            mean /= samples.size();
+            analysed = false;
+        }
+        void do_analysis_complete(nonius::sample_analysis<nonius::fp_seconds> const& analysis) override {
+            mean = analysis.mean.point;
+            deviation = analysis.standard_deviation.point;
+            analysed = true;
+        }
+        void do_benchmark_failure(std::exception_ptr) override {
+            report_stream() << "benchmark aborted\n";
+        }
+        void do_benchmark_complete() override {
+            report_stream() << "mean: " << nonius::detail::pretty_duration(mean);
+            if(analysed) report_stream() << ", std dev: " << nonius::detail::pretty_duration(deviation);
+            report_stream() << "\n";
+            if(!latest_stats().note.empty()) report_stream() << latest_stats().note << "\n";
+            if(!latest_stats().recorded) return;
+            hlife::cellspace_stats const& s = latest_stats().stats;
+            report_stream() << s.cells << " cells, " << s.bytes_per_cell() << " bytes/cell";
+            if(latest_stats().heap_recorded) report_stream() << ", peak heap " << latest_stats().peak_heap << " bytes";
+            if(latest_stats().generations) report_stream() << ", " << latest_stats().generations / mean.count() << " generations/s";
+            if(!hlife::stats_enabled) {
+                report_stream() << "\n";
+                return;
+            }
+            std::uint64_t built = s.nodes.inserts + s.tiles.inserts;
+            report_stream() << ", " << built / mean.count() << " cells built/s"
+                            << ", memo hit rate " << 100 * s.memo_hit_rate() << "%\n";
+            report_index("node", s.nodes);
+            report_index("tile", s.tiles);
+            // Cells are gathered by level like the evaluations are, with
+            // the last row holding all the levels from there up.
+            std::vector<std::size_t> cells(s.levels.size());
+            std::vector<std::size_t> const& reachable = latest_stats().cells_per_level;
+            for(std::size_t i = 0; i < reachable.size(); ++i) cells[std::min(i, cells.size() - 1)] += reachable[i];
+            report_stream() << "level      cells    results result hits      steps  step hits\n";
+            for(std::size_t i = 0; i < s.levels.size(); ++i) {
+                hlife::level_stats const& l = s.levels[i];
+                if(cells[i] == 0 && l.results == 0 && l.result_hits == 0 && l.steps == 0 && l.step_hits == 0) continue;
+                std::string level = std::to_string(i) + (i + 1 == s.levels.size()? "+" : "");
+                report_stream() << std::setw(5) << level << std::setw(11) << cells[i]
+                                << std::setw(11) << l.results << std::setw(12) << l.result_hits
+                                << std::setw(11) << l.steps << std::setw(11) << l.step_hits << "\n";
+            }
+        }
+
+        // Lookups in an index, with the share of those that probed each
+        // number of slots.
+        void report_index(char const* name, hlife::index_stats const& s) {
+            report_stream() << name << " index: " << s.hits << " hits, " << s.inserts << " inserts"
+                            << ", mean probe " << s.mean_probe_length() << ", probes";
+            for(std::size_t i = 0; i < s.probe_lengths.size(); ++i) {
+                double share = s.lookups()? 100.0 * s.probe_lengths[i] / s.lookups() : 0;
+                report_stream() << " " << (i + 1) << (i + 1 == s.probe_lengths.size()? "+: " : ": ") << share << "%";
+            }
+            report_stream() << "\n";
+        }
+
+        nonius::fp_seconds mean;
+        nonius::fp_seconds deviation;
+        bool analysed = false;
+    };
+
+    // The statistics are reported by default; the plain timings remain
+    // available from the "standard" reporter.
+    bool const stats_reported_by_default = (nonius::global_reporter_registry()[""].reset(new stats_reporter), true);
+}
+
+NONIUS_BENCHMARK("generate-16384", [](nonius::chronometer meter) {
+    measure_recorded(meter, []{
+        auto space = std::make_shared<hlife::cellspace>();
+        hlife::world w(space, 16384);
+        w.root->result(*space, w.level);
+        return w;
+    });
+})
+
+NONIUS_BENCHMARK("footprint-soup-512", [](nonius::chronometer meter) {
+    measure_recorded(meter, []{
+        auto space = std::make_shared<hlife::cellspace>();
+        std::mt19937 rng(512);
+        random_cell(*space, 9, rng).result(*space, 9);
+        return space;
+    });
+})
+
+NONIUS_BENCHMARK("step-soup-1024", [](nonius::chronometer meter) {
+    measure_recorded(meter, []{
+        auto space = std::make_shared<hlife::cellspace>();
+        std::mt19937 rng(1024);
+        auto w = soup_world(space, 10, rng);
+        for(int i = 0; i < 4; ++i) w.step();
+        return w;
+    });
+})
+
+NONIUS_BENCHMARK("step-soup-1024-highlife", [](nonius::chronometer meter) {
+    measure_recorded(meter, []{
+        auto space = std::make_shared<hlife::basic_cellspace<highlife>>();
+        std::mt19937 rng(1024);
+        auto w = soup_world(space, 10, rng);
+        for(int i = 0; i < 4; ++i) w.step();
+        return w;
+    });
+})
+
+NONIUS_BENCHMARK("step-soup-1024-gc-4M", [](nonius::chronometer meter) {
+    measure_recorded(meter, []{
+        auto space = std::make_shared<hlife::cellspace>();
+        space->set_budget(std::size_t(4) << 20, false);
+        std::mt19937 rng(1024);
+        auto w = soup_world(space, 10, rng);
+        for(int i = 0; i < 4; ++i) w.step();
+        return w;
+    });
+})
+
+NONIUS_BENCHMARK("step-soup-1024-parallel-1", [](nonius::chronometer meter) { step_soup_parallel(meter, 1); })
+NONIUS_BENCHMARK("step-soup-1024-parallel-8", [](nonius::chronometer meter) { step_soup_parallel(meter, 8); })
+NONIUS_BENCHMARK("step-soup-1024-parallel-16", [](nonius::chronometer meter) { step_soup_parallel(meter, 16); })
+NONIUS_BENCHMARK("step-soup-1024-parallel-32", [](nonius::chronometer meter) { step_soup_parallel(meter, 32); })
+
+NONIUS_BENCHMARK("advance-soup-512-step-1", [](nonius::chronometer meter) { advance_soup(meter, 1); })
+NONIUS_BENCHMARK("advance-soup-512-step-1024", [](nonius::chronometer meter) { advance_soup(meter, 1024); })
+NONIUS_BENCHMARK("advance-soup-512-max-step", [](nonius::chronometer meter) {
+    // The same soup advanced by the largest strides the world allows: each
+    // step is half the sides of the world, 256, 512 and then 1024
+    // generations, as the world grows to keep the soup clear of its edges.
+    measure_recorded(meter, []{
+        auto space = std::make_shared<hlife::cellspace>();
+        std::mt19937 rng(1024);
+        auto w = soup_world(space, 9, rng);
+        while(w.current_generation() < 1024) w.step();
+        return w;
+    });
+})
+
+NONIUS_BENCHMARK("load-rle-soup-2048", [](nonius::chronometer meter) {
+    load_pattern(meter, saved_soup(11, 256, save_rle), load_rle);
 })
+
+NONIUS_BENCHMARK("load-macrocell-soup-2048", [](nonius::chronometer meter) {
+    load_pattern(meter, saved_soup(11, 256, save_macrocell), load_macrocell);
+})
+
+// A fresh 8192x8192 soup, about 50MB of RLE.
+NONIUS_BENCHMARK("load-rle-soup-16384", [](nonius::chronometer meter) {
+    load_pattern(meter, saved_soup(14, 0, save_rle), load_rle);
+})
+
+// The same soup as a macrocell file.
+NONIUS_BENCHMARK("load-macrocell-soup-16384", [](nonius::chronometer meter) {
+    load_pattern(meter, saved_soup(14, 0, save_macrocell), load_macrocell);
+})
+
+NONIUS_BENCHMARK("set-cells-65536-batched", [](nonius::chronometer meter) {
+    auto edits = random_edits(65536);
+    measure_recorded(meter, [&edits]{
+        hlife::world w(std::make_shared<hlife::cellspace>(), 4);
+        w.set_cells(edits);
+        return w;
+    });
+})
+
+NONIUS_BENCHMARK("set-cells-65536-one-by-one", [](nonius::chronometer meter) {
+    auto edits = random_edits(65536);
+    measure_recorded(meter, [&edits]{
+        hlife::world w(std::make_shared<hlife::cellspace>(), 4);
+        for(auto const& e : edits) w.set_cell(e.x, e.y, e.alive);
+        return w;
+    });
+})
+
+NONIUS_BENCHMARK("render-1024x768-zoom-0", [](nonius::chronometer meter) { render_soup(meter, 0); })
+NONIUS_BENCHMARK("render-1024x768-zoom-2", [](nonius::chronometer meter) { render_soup(meter, 2); })
+NONIUS_BENCHMARK("render-1024x768-zoom-4", [](nonius::chronometer meter) { render_soup(meter, 4); })
+NONIUS_BENCHMARK("render-1024x768-zoom-8", [](nonius::chronometer meter) { render_soup(meter, 8); })
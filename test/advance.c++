@@ -0,0 +1,132 @@
+// Yajna
+//
+// Written in 2015 by Martinho Fernandes <martinho.fernandes@gmail.com>
+//
+// To the extent possible under law, the author(s) have dedicated all copyright and related
+// and neighboring rights to this software to the public domain worldwide. This software is
+// distributed without any warranty.
+//
+// You should have received a copy of the CC0 Public Domain Dedication along with this software.
+// If not, see <http://creativecommons.org/publicdomain/zero/1.0/>
+
+// Tests of advancing worlds by arbitrary numbers of generations
+
+#include "test.h++"
+
+namespace {
+    // Advances a soup by a mix of generation counts, checking every stop
+    // against the naive simulator.
+    template <typename Rule>
+    void check_advance(std::uint32_t seed) {
+        std::mt19937 rng(seed);
+        test::cells expected = test::soup(-12, -9, 24, 20, 0.4, rng);
+        auto w = test::make_world(std::make_shared<hlife::basic_cellspace<Rule>>(), expected);
+        std::uint64_t const counts[] = { 1, 2, 3, 0, 5, 8, 1, 13, 4, 7, 16, 6 };
+        std::uint64_t generation = 0;
+        for(std::uint64_t n : counts) {
+            w.advance(n);
+            expected = test::naive_advance<Rule>(expected, n);
+            generation += n;
+            CHECK(w.current_generation() == generation);
+            CHECK(test::live_cells(w) == expected);
+            CHECK(w.population() == expected.size());
+        }
+    }
+
+    // The number of smaller steps memoised in the cellspace.
+    template <typename Rule>
+    std::size_t memoised_steps(hlife::basic_cellspace<Rule> const& space) {
+        std::size_t n = 0;
+        for(auto const& s : space.steps) n += s.count;
+        return n;
+    }
+}
+
+TEST_CASE(advance_matches_naive_life) {
+    check_advance<hlife::life>(3);
+    check_advance<hlife::life>(4);
+}
+
+TEST_CASE(advance_matches_naive_other_rules) {
+    check_advance<test::highlife>(5);
+    check_advance<test::life_with_eight>(6);
+}
+
+TEST_CASE(memory_in_use_counts_memoised_steps) {
+    std::mt19937 rng(12);
+    auto space = std::make_shared<hlife::cellspace>();
+    auto w = test::make_world(space, test::soup(-16, -16, 32, 32, 0.35, rng));
+    w.advance(3);
+    std::size_t steps = memoised_steps(*space);
+    CHECK(steps != 0);
+    CHECK(space->memory_in_use() >= space->size() * sizeof(hlife::cell) + space->index_memory()
+                                    + steps * sizeof(hlife::cellspace::step_slot));
+    CHECK(space->memory_usage() >= space->memory_in_use());
+}
+
+TEST_CASE(small_steps_are_memoised) {
+    // A second world with the same soup in the same cellspace is advanced
+    // entirely from the memo: no cell and no step is added.
+    std::mt19937 rng(26);
+    test::cells soup = test::soup(-16, -16, 32, 32, 0.35, rng);
+    auto space = std::make_shared<hlife::cellspace>();
+    auto a = test::make_world(space, soup);
+    for(int i = 0; i < 20; ++i) a.advance(3);
+    std::size_t cells = space->size();
+    std::size_t steps = memoised_steps(*space);
+    CHECK(steps != 0);
+
+    auto b = test::make_world(space, soup);
+    for(int i = 0; i < 20; ++i) b.advance(3);
+    CHECK(b.root == a.root);
+    CHECK(space->size() == cells);
+    CHECK(memoised_steps(*space) == steps);
+    CHECK(test::live_cells(b) == test::naive_advance<hlife::life>(soup, 60));
+}
+
+TEST_CASE(memoised_steps_are_weak) {
+    // Steps are kept by a collection only while both their ends survive.
+    // Once the world is gone only those of the empty cells remain.
+    std::mt19937 rng(27);
+    test::cells soup = test::soup(-16, -16, 32, 32, 0.35, rng);
+    auto space = std::make_shared<hlife::cellspace>();
+    auto ends_survive = [&](hlife::cellspace::step_slot const& x) {
+        hlife::cell_ref r = *x.result;
+        bool result_held = x.level == 4? &space->tile_with(r.tile) == &r
+                                       : &space->cell_with(*r.q.nw, *r.q.ne, *r.q.sw, *r.q.se) == &r;
+        return result_held && &space->cell_with(*x.c->q.nw, *x.c->q.ne, *x.c->q.sw, *x.c->q.se) == x.c;
+    };
+    {
+        auto w = test::make_world(space, soup);
+        w.advance(5);
+        std::size_t steps = memoised_steps(*space);
+        space->collect();
+        CHECK(memoised_steps(*space) < steps);
+        std::size_t cells = space->size();
+        for(auto const& s : space->steps)
+            for(auto const& x : s.index)
+                if(x.c) CHECK(ends_survive(x));
+        CHECK(space->size() == cells);
+        w.advance(5);
+        CHECK(test::live_cells(w) == test::naive_advance<hlife::life>(soup, 10));
+    }
+    space->collect();
+    for(auto const& s : space->steps)
+        for(auto const& x : s.index)
+            if(x.c) CHECK(x.c == &space->empty_cell(x.level) && x.result == &space->empty_cell(x.level-1));
+}
+
+TEST_CASE(advance_takes_huge_strides) {
+    // A glider moves one cell diagonally every four generations, however
+    // far it is sent.
+    test::cells glider { { 1, 0 }, { 2, 1 }, { 0, 2 }, { 1, 2 }, { 2, 2 } };
+    auto w = test::make_world(std::make_shared<hlife::cellspace>(), glider);
+    std::uint64_t const generations = (std::uint64_t(1) << 40) + 4;
+    w.advance(0);
+    CHECK(w.current_generation() == 0);
+    w.advance(generations);
+    CHECK(w.current_generation() == generations);
+    CHECK(w.population() == 5);
+    std::int64_t const shift = static_cast<std::int64_t>(generations / 4);
+    for(auto const& c : glider) CHECK(w.get_cell(c.first + shift, c.second + shift));
+}
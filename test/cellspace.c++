@@ -0,0 +1,71 @@
+// Yajna
+//
+// Written in 2015 by Martinho Fernandes <martinho.fernandes@gmail.com>
+//
+// To the extent possible under law, the author(s) have dedicated all copyright and related
+// and neighboring rights to this software to the public domain worldwide. This software is
+// distributed without any warranty.
+//
+// You should have received a copy of the CC0 Public Domain Dedication along with this software.
+// If not, see <http://creativecommons.org/publicdomain/zero/1.0/>
+
+// Tests of the hash-consing of cells in a cellspace
+
+#include "test.h++"
+
+TEST_CASE(cells_are_unique) {
+    // Enough cells to grow every shard of both indices several times over.
+    hlife::cellspace space;
+    std::mt19937_64 rng(21);
+    std::vector<std::uint64_t> bits(20000);
+    for(auto& b : bits) b = rng();
+    std::vector<hlife::cell_ptr> tiles;
+    for(auto b : bits) tiles.push_back(&space.tile_with(b));
+    std::vector<hlife::cell_ptr> nodes;
+    for(std::size_t i = 0; i + 3 < tiles.size(); ++i)
+        nodes.push_back(&space.cell_with(*tiles[i], *tiles[i+1], *tiles[i+2], *tiles[i+3]));
+    CHECK(space.size() == tiles.size() + nodes.size());
+
+    for(std::size_t i = 0; i < tiles.size(); ++i) {
+        CHECK(&space.tile_with(bits[i]) == tiles[i]);
+        CHECK(tiles[i]->tile == bits[i]);
+    }
+    for(std::size_t i = 0; i < nodes.size(); ++i) {
+        CHECK(&space.cell_with(*tiles[i], *tiles[i+1], *tiles[i+2], *tiles[i+3]) == nodes[i]);
+        CHECK(nodes[i]->q.nw == tiles[i] && nodes[i]->q.se == tiles[i+3]);
+    }
+    // Quadrants in another order make another cell.
+    CHECK(&space.cell_with(*tiles[1], *tiles[0], *tiles[2], *tiles[3]) != nodes[0]);
+    CHECK(space.size() == tiles.size() + nodes.size() + 1);
+}
+
+TEST_CASE(empty_cells_are_shared) {
+    hlife::cellspace space;
+    hlife::cell_ref e = space.empty_cell(5);
+    CHECK(&e == &space.cell_with(space.empty_cell(4), space.empty_cell(4), space.empty_cell(4), space.empty_cell(4)));
+    CHECK(&space.empty_cell(3) == &space.tile_with(0));
+    CHECK(e.population(5) == 0);
+}
+
+TEST_CASE(running_out_of_ids_throws) {
+    // Pretend all but the last two ids are taken, without making those
+    // cells. The last slab is real so the remaining cells can be built.
+    using space_type = hlife::cellspace;
+    space_type space;
+    space.slabs[space_type::max_slabs - 1].reset(new space_type::storage[space_type::slab_cells]);
+    space.slab_count = space_type::max_slabs;
+    space.slab_used = space_type::slab_cells - 2;
+
+    hlife::cell_ref last = space.tile_with(1);
+    CHECK(last.tile == 1);
+    CHECK_THROWS(std::length_error, space.tile_with(2));
+    CHECK_THROWS(std::length_error, space.cell_with(last, last, last, last));
+    CHECK(&space.tile_with(1) == &last);
+    CHECK(space.size() == 1);
+
+    // Ids freed by a collection are available again.
+    space.collect();
+    CHECK(space.size() == 0);
+    CHECK(space.tile_with(2).tile == 2);
+    CHECK_THROWS(std::length_error, space.tile_with(3));
+}
@@ -0,0 +1,167 @@
+// Yajna
+//
+// Written in 2015 by Martinho Fernandes <martinho.fernandes@gmail.com>
+//
+// To the extent possible under law, the author(s) have dedicated all copyright and related
+// and neighboring rights to this software to the public domain worldwide. This software is
+// distributed without any warranty.
+//
+// You should have received a copy of the CC0 Public Domain Dedication along with this software.
+// If not, see <http://creativecommons.org/publicdomain/zero/1.0/>
+
+// Tests of garbage collection in cellspaces
+
+#include "test.h++"
+
+namespace {
+    // All the cells held by the cellspace, tiles included.
+    template <typename Rule>
+    std::set<hlife::cell_ptr> held_cells(hlife::basic_cellspace<Rule> const& space) {
+        std::set<hlife::cell_ptr> held;
+        auto add = [&](typename hlife::basic_cellspace<Rule>::shards const& index) {
+            for(auto const& s : index)
+                for(auto const& x : s.index)
+                    if(x.id) held.insert(&space.at(x.id));
+        };
+        add(space.nodes);
+        add(space.tiles);
+        return held;
+    }
+
+    // Checks that every cell of the tree is the one the cellspace gives for
+    // its quadrants or bits.
+    template <typename Rule>
+    void check_canonical(hlife::basic_cellspace<Rule> const& space, hlife::cell_ref c, int level) {
+        if(level == 3) {
+            CHECK(&space.tile_with(c.tile) == &c);
+            return;
+        }
+        CHECK(&space.cell_with(*c.q.nw, *c.q.ne, *c.q.sw, *c.q.se) == &c);
+        check_canonical(space, *c.q.nw, level-1);
+        check_canonical(space, *c.q.ne, level-1);
+        check_canonical(space, *c.q.sw, level-1);
+        check_canonical(space, *c.q.se, level-1);
+    }
+}
+
+TEST_CASE(collection_keeps_results) {
+    // Collecting on every change of root, with or without the memoised
+    // futures, must give the same worlds as never collecting.
+    std::mt19937 rng(11);
+    test::cells soup = test::soup(-16, -16, 32, 32, 0.35, rng);
+    std::vector<test::cells> expected;
+    auto reference = test::make_world(std::make_shared<hlife::cellspace>(), soup);
+    for(int i = 0; i < 6; ++i) {
+        reference.advance(37);
+        expected.push_back(test::live_cells(reference));
+    }
+    bool const keep_futures[] = { true, false };
+    for(bool keep : keep_futures) {
+        auto space = std::make_shared<hlife::cellspace>();
+        space->set_budget(1, keep);
+        auto w = test::make_world(space, soup);
+        for(int i = 0; i < 6; ++i) {
+            w.advance(37);
+            CHECK(test::live_cells(w) == expected[i]);
+        }
+        space->collect(keep);
+        CHECK(test::live_cells(w) == expected.back());
+    }
+}
+
+TEST_CASE(collection_frees_unreachable_cells) {
+    std::mt19937 rng(22);
+    test::cells soup = test::soup(-16, -16, 32, 32, 0.35, rng);
+    auto space = std::make_shared<hlife::cellspace>();
+    auto run = [&] {
+        auto w = test::make_world(space, soup);
+        w.advance(200);
+    };
+    run();
+    std::size_t slabs = space->slab_count;
+    CHECK(space->size() > space->empties.size());
+
+    // Only the empty cells are left once the world is gone, and the
+    // space freed is reused by the next run.
+    space->collect();
+    CHECK(space->size() == space->empties.size());
+    run();
+    space->collect();
+    CHECK(space->size() == space->empties.size());
+    CHECK(space->slab_count == slabs);
+}
+
+TEST_CASE(collection_keeps_cells_canonical) {
+    std::mt19937 rng(23);
+    test::cells expected = test::soup(-16, -16, 32, 32, 0.35, rng);
+    bool const keep_futures[] = { true, false };
+    for(bool keep : keep_futures) {
+        auto space = std::make_shared<hlife::cellspace>();
+        auto w = test::make_world(space, expected);
+        w.advance(37);
+        space->collect(keep);
+        check_canonical(*space, *w.root, w.level);
+
+        // No survivor remembers a future that was swept.
+        std::set<hlife::cell_ptr> held = held_cells(*space);
+        for(auto const& s : space->nodes) {
+            for(auto const& x : s.index) {
+                if(!x.id) continue;
+                hlife::cell_ptr future = space->at(x.id).q.future.load();
+                CHECK(!future || held.count(future));
+            }
+        }
+
+        // Evaluation carries on from the survivors.
+        w.advance(100);
+        CHECK(test::live_cells(w) == test::naive_advance<hlife::life>(expected, 137));
+    }
+}
+
+TEST_CASE(roots_are_counted) {
+    hlife::cellspace space;
+    hlife::cell_ref t = space.tile_with(0x0102040810204080ull);
+    hlife::cell_ref c = space.cell_with(t, t, t, t);
+    space.add_root(c, 4);
+    space.add_root(c, 4);
+    space.remove_root(c, 4);
+    space.collect();
+    CHECK(space.size() == 2);
+    CHECK(&space.cell_with(t, t, t, t) == &c);
+    CHECK(space.size() == 2);
+    space.remove_root(c, 4);
+    space.collect();
+    CHECK(space.size() == 0);
+
+    // Copies of worlds hold their roots as well.
+    auto shared = std::make_shared<hlife::cellspace>();
+    test::cells glider { { 1, 0 }, { 2, 1 }, { 0, 2 }, { 1, 2 }, { 2, 2 } };
+    auto w = test::make_world(shared, glider);
+    {
+        auto copy = w;
+        w.advance(8);
+        shared->collect();
+        CHECK(test::live_cells(copy) == glider);
+    }
+    shared->collect();
+    CHECK(test::live_cells(w) == test::naive_advance<hlife::life>(glider, 8));
+}
+
+TEST_CASE(budget_triggers_collection) {
+    std::mt19937 rng(24);
+    auto space = std::make_shared<hlife::cellspace>();
+    auto w = test::make_world(space, test::soup(-16, -16, 32, 32, 0.35, rng));
+    w.advance(50);
+    CHECK(!space->collect_if_needed());
+
+    space->set_budget(std::size_t(1) << 40);
+    CHECK(!space->collect_if_needed());
+
+    // Once over budget, the threshold is raised above what survives so
+    // that the next check does not collect again straight away.
+    space->set_budget(1);
+    std::size_t before = space->size();
+    CHECK(space->collect_if_needed());
+    CHECK(space->size() < before);
+    CHECK(!space->collect_if_needed());
+}
@@ -0,0 +1,98 @@
+// Yajna
+//
+// Written in 2015 by Martinho Fernandes <martinho.fernandes@gmail.com>
+//
+// To the extent possible under law, the author(s) have dedicated all copyright and related
+// and neighboring rights to this software to the public domain worldwide. This software is
+// distributed without any warranty.
+//
+// You should have received a copy of the CC0 Public Domain Dedication along with this software.
+// If not, see <http://creativecommons.org/publicdomain/zero/1.0/>
+
+// Tests of the bit-parallel kernel that evaluates 4-cells
+
+#include "test.h++"
+
+namespace {
+    // Packs the cells in the 8x8 square at (x, y) as a tile.
+    std::uint64_t tile_of(test::cells const& live, int x, int y) {
+        std::uint64_t bits = 0;
+        for(int j = 0; j < 8; ++j)
+            for(int i = 0; i < 8; ++i)
+                if(live.count(std::make_pair(x + i, y + j))) bits |= std::uint64_t(1) << (63 - 8 * j - i);
+        return bits;
+    }
+
+    // Checks the kernel against the naive simulator on random 16x16 blocks.
+    // After g generations the cells within g of the block's edge depend on
+    // cells outside it, but the central tile does not for g up to four.
+    template <typename Rule>
+    void check_evolve(std::mt19937& rng) {
+        double const densities[] = { 0.1, 0.3, 0.5, 0.9 };
+        for(double density : densities) {
+            for(int n = 0; n < 64; ++n) {
+                test::cells block = test::soup(0, 0, 16, 16, density, rng);
+                std::uint64_t nw = tile_of(block, 0, 0), ne = tile_of(block, 8, 0);
+                std::uint64_t sw = tile_of(block, 0, 8), se = tile_of(block, 8, 8);
+                test::cells expected = block;
+                for(int g = 0; g <= 4; ++g) {
+                    CHECK(hlife::cell::evolve<Rule>(nw, ne, sw, se, g) == tile_of(expected, 4, 4));
+                    expected = test::naive_step(expected, Rule());
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE(evolve_matches_naive_life) {
+    std::mt19937 rng(1);
+    check_evolve<hlife::life>(rng);
+}
+
+TEST_CASE(evolve_matches_naive_other_rules) {
+    std::mt19937 rng(2);
+    check_evolve<test::highlife>(rng);
+    check_evolve<test::life_with_eight>(rng);
+}
+
+TEST_CASE(evolve_zero_generations_is_the_centre) {
+    CHECK(hlife::cell::evolve<hlife::life>(0, 0, 0, 0x8000000000000000ull, 0) == 0x0000000008000000ull);
+    CHECK(hlife::cell::evolve<hlife::life>(0x0000000000000001ull, 0, 0, 0, 0) == 0x0000001000000000ull);
+}
+
+TEST_CASE(light_cones_bottom_out_at_tiles) {
+    hlife::point const origin { 0, 0, 0 };
+    auto in_cone = [](int level, hlife::point center, int x, int y, int t) {
+        return hlife::cell::in_light_cone(level, center, hlife::point{ x, y, t });
+    };
+
+    // A tile holds its 8x8 cells at its own time only.
+    CHECK(in_cone(3, origin, -4, -4, 0));
+    CHECK(in_cone(3, origin, 3, 3, 0));
+    CHECK(!in_cone(3, origin, 4, 0, 0));
+    CHECK(!in_cone(3, origin, 0, -5, 0));
+    CHECK(!in_cone(3, origin, 0, 0, 1));
+    CHECK(in_cone(3, hlife::point{ 20, -12, 7 }, 16, -16, 7));
+
+    // A 4-cell holds its 16x16 cells now, and its central tile four
+    // generations later. Quadrants are told apart along the right axes.
+    CHECK(in_cone(4, origin, -8, -8, 0));
+    CHECK(in_cone(4, origin, 7, -8, 0));
+    CHECK(in_cone(4, origin, -8, 7, 0));
+    CHECK(in_cone(4, origin, 7, 7, 0));
+    CHECK(!in_cone(4, origin, 8, 0, 0));
+    CHECK(in_cone(4, origin, -4, 3, 4));
+    CHECK(!in_cone(4, origin, -5, 0, 4));
+    CHECK(!in_cone(4, origin, 0, 0, 1));
+    CHECK(!in_cone(4, origin, -8, -8, 4));
+    CHECK(!in_cone(4, origin, 0, 0, -1));
+
+    // A 5-cell holds its future 4-cell eight generations later, which
+    // holds its own future four more generations later.
+    CHECK(in_cone(5, origin, -16, 15, 0));
+    CHECK(in_cone(5, origin, -8, 7, 8));
+    CHECK(!in_cone(5, origin, -9, 0, 8));
+    CHECK(in_cone(5, origin, -4, 3, 12));
+    CHECK(!in_cone(5, origin, -8, -8, 12));
+    CHECK(!in_cone(5, origin, 0, 0, 10));
+}
@@ -0,0 +1,36 @@
+// Yajna
+//
+// Written in 2015 by Martinho Fernandes <martinho.fernandes@gmail.com>
+//
+// To the extent possible under law, the author(s) have dedicated all copyright and related
+// and neighboring rights to this software to the public domain worldwide. This software is
+// distributed without any warranty.
+//
+// You should have received a copy of the CC0 Public Domain Dedication along with this software.
+// If not, see <http://creativecommons.org/publicdomain/zero/1.0/>
+
+// Test runner: runs every test case, or those named on the command line
+
+#include "test.h++"
+
+#include <exception>
+#include <iostream>
+#include <string>
+
+int main(int argc, char** argv) {
+    int failed = 0, run = 0;
+    for(auto const& t : test::registry()) {
+        bool selected = argc == 1;
+        for(int i = 1; i < argc; ++i) selected = selected || t.first == std::string(argv[i]);
+        if(!selected) continue;
+        ++run;
+        try {
+            t.second();
+        } catch(std::exception const& e) {
+            std::cout << "FAILED " << t.first << ": " << e.what() << "\n";
+            ++failed;
+        }
+    }
+    std::cout << (run - failed) << " of " << run << " test cases passed\n";
+    return failed == 0? 0 : 1;
+}
@@ -0,0 +1,145 @@
+// Yajna
+//
+// Written in 2015 by Martinho Fernandes <martinho.fernandes@gmail.com>
+//
+// To the extent possible under law, the author(s) have dedicated all copyright and related
+// and neighboring rights to this software to the public domain worldwide. This software is
+// distributed without any warranty.
+//
+// You should have received a copy of the CC0 Public Domain Dedication along with this software.
+// If not, see <http://creativecommons.org/publicdomain/zero/1.0/>
+
+// Tests of parallel evaluation against sequential evaluation
+
+#include "test.h++"
+
+namespace {
+    // Steps the same soup sequentially in one cellspace and in parallel in
+    // another, with several pools and cutoffs, comparing every step.
+    template <typename Rule>
+    void check_parallel_step(std::uint32_t seed) {
+        std::mt19937 rng(seed);
+        test::cells soup = test::soup(-32, -32, 64, 64, 0.3, rng);
+        std::vector<test::cells> expected;
+        std::vector<std::uint64_t> generations;
+        auto sequential = test::make_world(std::make_shared<hlife::basic_cellspace<Rule>>(), soup, 7);
+        for(int i = 0; i < 3; ++i) {
+            sequential.step();
+            expected.push_back(test::live_cells(sequential));
+            generations.push_back(sequential.current_generation());
+        }
+
+        unsigned const workers[] = { 1, 3, 8 };
+        int const cutoffs[] = { 4, 6, 8 };
+        for(unsigned n : workers) {
+            hlife::task_pool pool(n);
+            for(int cutoff : cutoffs) {
+                auto parallel = test::make_world(std::make_shared<hlife::basic_cellspace<Rule>>(), soup, 7);
+                for(int i = 0; i < 3; ++i) {
+                    parallel.step(pool, cutoff);
+                    CHECK(parallel.current_generation() == generations[i]);
+                    CHECK(test::live_cells(parallel) == expected[i]);
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE(parallel_step_matches_sequential_life) {
+    check_parallel_step<hlife::life>(13);
+}
+
+TEST_CASE(parallel_step_matches_sequential_other_rules) {
+    check_parallel_step<test::highlife>(14);
+    check_parallel_step<test::life_with_eight>(15);
+}
+
+TEST_CASE(parallel_step_shares_a_cellspace) {
+    // Parallel and sequential steps can be mixed on the same cellspace; the
+    // results memoised by one are reused by the other.
+    std::mt19937 rng(16);
+    test::cells soup = test::soup(-32, -32, 64, 64, 0.3, rng);
+    auto space = std::make_shared<hlife::cellspace>();
+    auto a = test::make_world(space, soup, 7);
+    auto b = test::make_world(space, soup, 7);
+    hlife::task_pool pool(4);
+    for(int i = 0; i < 3; ++i) {
+        a.step(pool, 5);
+        b.step();
+        CHECK(a.root == b.root);
+    }
+}
+
+TEST_CASE(parallel_advance_matches_naive) {
+    std::mt19937 rng(18);
+    test::cells expected = test::soup(-20, -20, 40, 40, 0.35, rng);
+    hlife::task_pool pool(4);
+    auto w = test::make_world(std::make_shared<hlife::cellspace>(), expected);
+    std::uint64_t const counts[] = { 1, 6, 100, 37, 64, 3 };
+    for(std::uint64_t n : counts) {
+        w.advance(n, pool, 5);
+        expected = test::naive_advance<hlife::life>(expected, n);
+        CHECK(test::live_cells(w) == expected);
+    }
+}
+
+namespace {
+    // Fibonacci numbers by naive fork-join recursion, throwing at the given
+    // argument, if any.
+    std::uint64_t fibonacci(int n, int throw_at = -1) {
+        if(n == throw_at) throw std::runtime_error("fibonacci");
+        if(n < 2) return static_cast<std::uint64_t>(n);
+        std::uint64_t a = 0, b = 0;
+        hlife::task_group group;
+        group.run([&a, n, throw_at] { a = fibonacci(n-1, throw_at); });
+        group.run([&b, n, throw_at] { b = fibonacci(n-2, throw_at); });
+        group.wait();
+        return a + b;
+    }
+}
+
+TEST_CASE(task_pool_runs_nested_tasks) {
+    unsigned const workers[] = { 1, 2, 5 };
+    for(unsigned n : workers) {
+        hlife::task_pool pool(n);
+        for(int i = 0; i < 3; ++i) {
+            std::uint64_t result = 0;
+            pool.execute([&result] { result = fibonacci(20); });
+            CHECK(result == 6765);
+        }
+    }
+}
+
+TEST_CASE(task_exceptions_reach_the_joining_thread) {
+    // Exceptions thrown deep in the recursion, on any worker, come out of
+    // execute() on the calling thread, and the pool can be used again.
+    hlife::task_pool pool(4);
+    for(int i = 0; i < 3; ++i) {
+        CHECK_THROWS(std::runtime_error, pool.execute([] { fibonacci(18, 3); }));
+        CHECK_THROWS(std::runtime_error, pool.execute([] { throw std::runtime_error("execute"); }));
+        std::uint64_t result = 0;
+        pool.execute([&result] { result = fibonacci(18); });
+        CHECK(result == 2584);
+    }
+    // Outside of execute() tasks run inline and throw straight away.
+    CHECK_THROWS(std::runtime_error, fibonacci(10, 2));
+}
+
+TEST_CASE(parallel_step_throws_when_the_cellspace_is_full) {
+    // Only a few ids are left, far fewer than a step needs. The failure
+    // propagates out of the step, which leaves the world as it was.
+    using space_type = hlife::cellspace;
+    std::mt19937 rng(25);
+    test::cells soup = test::soup(-32, -32, 64, 64, 0.3, rng);
+    auto space = std::make_shared<space_type>();
+    auto w = test::make_world(space, soup, 7);
+    space->empty_cell(10);
+    space->slabs[space_type::max_slabs - 1].reset(new space_type::storage[space_type::slab_cells]);
+    space->slab_count = space_type::max_slabs;
+    space->slab_used = space_type::slab_cells - 200;
+    hlife::task_pool pool(4);
+    CHECK_THROWS(std::length_error, w.step(pool, 4));
+    CHECK(test::live_cells(w) == soup);
+    CHECK(w.current_generation() == 0);
+    CHECK(!space->concurrent.load());
+}
@@ -0,0 +1,197 @@
+// Yajna
+//
+// Written in 2015 by Martinho Fernandes <martinho.fernandes@gmail.com>
+//
+// To the extent possible under law, the author(s) have dedicated all copyright and related
+// and neighboring rights to this software to the public domain worldwide. This software is
+// distributed without any warranty.
+//
+// You should have received a copy of the CC0 Public Domain Dedication along with this software.
+// If not, see <http://creativecommons.org/publicdomain/zero/1.0/>
+
+// Tests of the pattern file loaders and savers
+
+#include "test.h++"
+
+namespace {
+    template <typename Rule>
+    hlife::basic_world<Rule> load_rle(std::string const& text) {
+        std::istringstream in(text);
+        return hlife::patterns::load_rle(in, std::make_shared<hlife::basic_cellspace<Rule>>());
+    }
+    template <typename Rule>
+    hlife::basic_world<Rule> load_macrocell(std::string const& text) {
+        std::istringstream in(text);
+        return hlife::patterns::load_macrocell(in, std::make_shared<hlife::basic_cellspace<Rule>>());
+    }
+
+    // Saves a world in both formats and loads it back, checking that the
+    // same cells come back at the same place from the top-left corner.
+    template <typename Rule>
+    void check_round_trips(hlife::basic_world<Rule> const& w) {
+        test::cells expected = test::live_cells_from_corner(w);
+
+        std::ostringstream rle;
+        hlife::patterns::save_rle(rle, w);
+        auto from_rle = load_rle<Rule>(rle.str());
+        CHECK(test::live_cells_from_corner(from_rle) == expected);
+        CHECK(from_rle.level <= w.level);
+
+        std::ostringstream macrocell;
+        hlife::patterns::save_macrocell(macrocell, w);
+        auto from_macrocell = load_macrocell<Rule>(macrocell.str());
+        CHECK(test::live_cells_from_corner(from_macrocell) == expected);
+        CHECK(from_macrocell.level == w.level);
+    }
+}
+
+TEST_CASE(rle_glider) {
+    auto w = load_rle<hlife::life>("#N Glider\n#C A comment\nx = 3, y = 3, rule = B3/S23\nbob$2bo$3o!\n");
+    test::cells expected { { 1, 0 }, { 2, 1 }, { 0, 2 }, { 1, 2 }, { 2, 2 } };
+    CHECK(w.level == 4);
+    CHECK(test::live_cells_from_corner(w) == expected);
+}
+
+TEST_CASE(rle_runs_span_tiles_and_lines) {
+    // A row of 20 cells, two empty rows, and a cell past the first band.
+    auto w = load_rle<hlife::life>("x = 20, y = 12\n20o3$\n9b\no\n7$3bo!");
+    test::cells expected;
+    for(int x = 0; x < 20; ++x) expected.emplace(x, 0);
+    expected.emplace(9, 3);
+    expected.emplace(3, 10);
+    CHECK(w.level == 5);
+    CHECK(test::live_cells_from_corner(w) == expected);
+}
+
+TEST_CASE(rle_rejects_garbage) {
+    CHECK_THROWS(hlife::pattern_error, load_rle<hlife::life>("x = 1, y = 1\n2o?o!"));
+}
+
+TEST_CASE(macrocell_glider) {
+    auto w = load_macrocell<hlife::life>("[M2] (golly)\n#R B3/S23\n.*$..*$***$\n4 1 0 0 0\n");
+    test::cells expected { { 1, 0 }, { 2, 1 }, { 0, 2 }, { 1, 2 }, { 2, 2 } };
+    CHECK(w.level == 4);
+    CHECK(test::live_cells_from_corner(w) == expected);
+}
+
+TEST_CASE(macrocell_rejects_garbage) {
+    CHECK_THROWS(hlife::pattern_error, load_macrocell<hlife::life>("#R B3/S23\n"));
+    CHECK_THROWS(hlife::pattern_error, load_macrocell<hlife::life>("[M2]\n5 1 0 0 0\n"));
+    CHECK_THROWS(hlife::pattern_error, load_macrocell<hlife::life>("[M2]\n.*$\n5 1 0 0 0\n"));
+    CHECK_THROWS(hlife::pattern_error, load_macrocell<hlife::life>("[M2]\n"));
+}
+
+TEST_CASE(patterns_round_trip) {
+    std::mt19937 rng(17);
+    auto soup = test::make_world(std::make_shared<hlife::cellspace>(), test::soup(-40, -30, 70, 50, 0.4, rng), 7);
+    check_round_trips(soup);
+    soup.advance(100);
+    check_round_trips(soup);
+
+    auto sparse = test::make_world(std::make_shared<hlife::cellspace>(), test::cells{ { -300, 5 }, { 200, -100 }, { 0, 0 } });
+    check_round_trips(sparse);
+
+    hlife::basic_world<test::highlife> empty(std::make_shared<hlife::basic_cellspace<test::highlife>>(), 6);
+    check_round_trips(empty);
+}
+
+TEST_CASE(rle_skips_empty_bands) {
+    // Long runs of empty rows and columns cost nothing.
+    auto w = load_rle<hlife::life>("x = 0, y = 0\n3o1000000000000$1000000000000bo!");
+    CHECK(w.level == 40);
+    CHECK(w.population() == 4);
+    CHECK(w.root->q.nw->population(39) == 3);
+    CHECK(w.root->q.ne->population(39) == 0);
+    CHECK(w.root->q.sw->population(39) == 0);
+    CHECK(w.root->q.se->population(39) == 1);
+    CHECK(w.get_cell(-(std::int64_t(1) << 39) + 2, -(std::int64_t(1) << 39)));
+}
+
+TEST_CASE(rle_rejects_overflow) {
+    CHECK_THROWS(hlife::pattern_error, load_rle<hlife::life>("x = 1, y = 1\n99999999999999999999o!"));
+    CHECK_THROWS(hlife::pattern_error, load_rle<hlife::life>("x = 1, y = 1\n4611686018427387905b!"));
+    CHECK_THROWS(hlife::pattern_error, load_rle<hlife::life>("x = 1, y = 1\n4611686018427387903$2$o!"));
+    CHECK_THROWS(hlife::pattern_error, load_rle<hlife::life>("x = 1, y = 1\n3000000000000000000b2000000000000000000bo!"));
+}
+
+TEST_CASE(patterns_check_the_rule) {
+    std::string const glider = "bob$2bo$3o!\n";
+    CHECK(load_rle<hlife::life>("x = 3, y = 3, rule = b3/s23\n" + glider).population() == 5);
+    CHECK(load_rle<hlife::life>("x = 3, y = 3, rule = S32/B3\n" + glider).population() == 5);
+    CHECK(load_rle<hlife::life>("x = 3, y = 3, rule = 23/3\n" + glider).population() == 5);
+    CHECK(load_rle<hlife::life>("x = 3, y = 3\n" + glider).population() == 5);
+    CHECK(load_rle<test::highlife>("x = 3,y = 3,rule=B36/S23\n" + glider).population() == 5);
+    CHECK(load_rle<test::highlife>("#C no header\n" "x = 3, y = 3, rule = 23/36\n" + glider).population() == 5);
+    CHECK_THROWS(hlife::pattern_error, load_rle<test::highlife>("x = 3, y = 3, rule = B3/S23\n" + glider));
+    CHECK_THROWS(hlife::pattern_error, load_rle<test::highlife>(glider));
+    CHECK_THROWS(hlife::pattern_error, load_rle<hlife::life>("x = 3, y = 3, rule = B36/S23\n" + glider));
+    CHECK_THROWS(hlife::pattern_error, load_rle<hlife::life>("x = 3, y = 3, rule = B3/S23:T10,10\n" + glider));
+    CHECK_THROWS(hlife::pattern_error, load_rle<hlife::life>("x = 3, y = 3, rule = B33/S23\n" + glider));
+    CHECK_THROWS(hlife::pattern_error, load_rle<hlife::life>("x = 3, y = 3, rule = B3S23\n" + glider));
+
+    std::string const tile = ".*$..*$***$\n4 1 0 0 0\n";
+    CHECK(load_macrocell<test::highlife>("[M2] (golly)\n#R B36/S23\n" + tile).population() == 5);
+    CHECK(load_macrocell<hlife::life>("[M2] (golly)\n" + tile).population() == 5);
+    CHECK_THROWS(hlife::pattern_error, load_macrocell<test::highlife>("[M2] (golly)\n#R B3/S23\n" + tile));
+    CHECK_THROWS(hlife::pattern_error, load_macrocell<test::highlife>("[M2] (golly)\n" + tile));
+    CHECK_THROWS(hlife::pattern_error, load_macrocell<test::life_with_eight>("[M2] (golly)\n#R B3/S23\n" + tile));
+}
+
+TEST_CASE(macrocell_writes_each_cell_once) {
+    // A grid of blocks in the middle of the world repeats the same few
+    // cells: the tile of a block, one cell for each level up to 6, the four
+    // corners of the grid and the root.
+    test::cells blocks;
+    for(int y = -64; y < 64; y += 8)
+        for(int x = -64; x < 64; x += 8)
+            blocks.insert({ { x, y }, { x + 1, y }, { x, y + 1 }, { x + 1, y + 1 } });
+    auto w = test::make_world(std::make_shared<hlife::cellspace>(), blocks, 8);
+
+    std::set<hlife::cell_ptr> unique;
+    std::function<void(hlife::cell_ref, int)> walk = [&](hlife::cell_ref c, int level) {
+        if(&c == &w.space->empty_cell(level) || !unique.insert(&c).second || level == 3) return;
+        walk(*c.q.nw, level-1);
+        walk(*c.q.ne, level-1);
+        walk(*c.q.sw, level-1);
+        walk(*c.q.se, level-1);
+    };
+    walk(*w.root, w.level);
+
+    std::ostringstream out;
+    hlife::patterns::save_macrocell(out, w);
+    std::istringstream lines(out.str());
+    std::string line;
+    std::size_t nodes = 0;
+    while(std::getline(lines, line)) nodes += line[0] != '[' && line[0] != '#';
+    CHECK(nodes == unique.size());
+    CHECK(nodes == 9);
+    CHECK(test::live_cells_from_corner(load_macrocell<hlife::life>(out.str())) == test::live_cells_from_corner(w));
+}
+
+TEST_CASE(macrocell_loads_huge_sparse_patterns) {
+    // A glider in the top-left corner of a world with sides 2^60 takes a
+    // node per level and nothing more.
+    std::string text = "[M2]\n.*$..*$***$\n";
+    for(int level = 4; level <= 60; ++level)
+        text += std::to_string(level) + " " + std::to_string(level - 3) + " 0 0 0\n";
+    auto w = load_macrocell<hlife::life>(text);
+    CHECK(w.level == 60);
+    CHECK(w.population() == 5);
+    std::int64_t corner = -(std::int64_t(1) << 59);
+    CHECK(w.get_cell(corner + 1, corner) && w.get_cell(corner + 2, corner + 2));
+    CHECK(!w.get_cell(corner, corner));
+    CHECK(w.space->size() <= 2 * 60);
+}
+
+TEST_CASE(rle_builds_repeats_once) {
+    // Stripes over a 256x256 square are a single tile repeated; streaming
+    // them in builds each cell of the result once.
+    std::string row;
+    for(int x = 0; x < 128; ++x) row += "ob";
+    std::string text = "x = 256, y = 256\n";
+    for(int y = 0; y < 256; ++y) text += row + "$\n";
+    auto w = load_rle<hlife::life>(text + "!");
+    CHECK(w.level == 8);
+    CHECK(w.population() == 128 * 256);
+    CHECK(w.space->size() <= 2 * 8);
+}
@@ -0,0 +1,152 @@
+// Yajna
+//
+// Written in 2015 by Martinho Fernandes <martinho.fernandes@gmail.com>
+//
+// To the extent possible under law, the author(s) have dedicated all copyright and related
+// and neighboring rights to this software to the public domain worldwide. This software is
+// distributed without any warranty.
+//
+// You should have received a copy of the CC0 Public Domain Dedication along with this software.
+// If not, see <http://creativecommons.org/publicdomain/zero/1.0/>
+
+// Tests of rendering viewports of worlds
+
+#include "test.h++"
+
+#include <limits>
+
+namespace {
+    // Rasterises live cells one by one. Pixels are 2^zoom cells apart from
+    // the one holding (x, y), rounded down, so they are told apart in key
+    // coordinates, which do not overflow. Viewports do not wrap around past
+    // the largest coordinates. The sums are exact: every term is a power of
+    // two that floats hold for all zooms used here.
+    std::vector<float> rasterise(test::cells const& live, std::int64_t x, std::int64_t y, int zoom,
+                                 std::size_t width, std::size_t height) {
+        std::vector<float> pixels(width * height);
+        float scale = static_cast<float>(std::ldexp(1.0, -2 * zoom));
+        std::uint64_t left = hlife::world::key(x) >> zoom, top = hlife::world::key(y) >> zoom;
+        for(auto const& c : live) {
+            std::uint64_t cx = hlife::world::key(c.first) >> zoom, cy = hlife::world::key(c.second) >> zoom;
+            if(cx < left || cy < top) continue;
+            if(cx - left < width && cy - top < height) pixels[(cy - top) * width + (cx - left)] += scale;
+        }
+        return pixels;
+    }
+
+    template <typename Rule>
+    std::vector<float> render(hlife::basic_world<Rule> const& w, std::int64_t x, std::int64_t y, int zoom,
+                              std::size_t width, std::size_t height) {
+        // Filled with garbage to check that every pixel is written.
+        std::vector<float> pixels(width * height, -1.0f);
+        w.render(x, y, zoom, width, height, pixels.data());
+        return pixels;
+    }
+
+    template <typename Rule>
+    void check_render(hlife::basic_world<Rule> const& w, test::cells const& live, std::int64_t x, std::int64_t y,
+                      int zoom, std::size_t width, std::size_t height) {
+        CHECK(render(w, x, y, zoom, width, height) == rasterise(live, x, y, zoom, width, height));
+    }
+}
+
+TEST_CASE(render_matches_brute_force) {
+    // Random viewports, many of them partly or wholly off the world, over a
+    // soup as it evolves. Small zooms go through the tiles cell by cell and
+    // larger ones through the populations of whole cells.
+    std::mt19937 rng(31);
+    test::cells live = test::soup(-50, -40, 100, 90, 0.35, rng);
+    auto w = test::make_world(std::make_shared<hlife::cellspace>(), live, 7);
+    std::uniform_int_distribution<std::int64_t> corner(-300, 200);
+    std::uniform_int_distribution<std::size_t> side(1, 100);
+    for(int i = 0; i < 4; ++i) {
+        for(int zoom = 0; zoom <= 8; ++zoom) {
+            for(int j = 0; j < 10; ++j) {
+                std::size_t width = side(rng), height = side(rng);
+                check_render(w, live, corner(rng), corner(rng), zoom, width, height);
+            }
+        }
+        w.advance(61);
+        live = test::live_cells(w);
+    }
+}
+
+TEST_CASE(render_rounds_the_corner_down) {
+    // The corner is rounded down to a multiple of 2^zoom, towards negative
+    // infinity.
+    std::mt19937 rng(32);
+    test::cells live = test::soup(-20, -20, 40, 40, 0.4, rng);
+    auto w = test::make_world(std::make_shared<hlife::cellspace>(), live, 6);
+    CHECK(render(w, 5, -7, 2, 8, 8) == render(w, 4, -8, 2, 8, 8));
+    CHECK(render(w, -1, -1, 3, 4, 4) == render(w, -8, -8, 3, 4, 4));
+    check_render(w, live, -13, 6, 2, 9, 5);
+    check_render(w, live, -1, -1, 4, 3, 3);
+}
+
+TEST_CASE(render_off_the_world) {
+    std::mt19937 rng(33);
+    test::cells live = test::soup(-32, -32, 64, 64, 0.4, rng);
+    auto w = test::make_world(std::make_shared<hlife::cellspace>(), live, 6);
+    // Straddling each edge and corner of the world.
+    std::int64_t const edges[] = { -32 - 10, 32 - 10 };
+    for(std::int64_t x : edges)
+        for(std::int64_t y : edges)
+            for(int zoom = 0; zoom <= 3; ++zoom)
+                check_render(w, live, x, y, zoom, 20, 20);
+    // Wholly outside, past either end of the coordinates.
+    std::int64_t const max = std::numeric_limits<std::int64_t>::max();
+    std::int64_t const min = std::numeric_limits<std::int64_t>::min();
+    CHECK(render(w, 1000, 0, 0, 10, 10) == std::vector<float>(100));
+    CHECK(render(w, max - 5, min, 0, 10, 10) == std::vector<float>(100));
+}
+
+TEST_CASE(render_zoomed_past_the_world) {
+    // A pixel may cover the whole world and more, and the world may fall
+    // across pixels wherever the viewport puts their edges.
+    std::mt19937 rng(34);
+    test::cells live = test::soup(-16, -16, 32, 32, 0.5, rng);
+    auto w = test::make_world(std::make_shared<hlife::cellspace>(), live, 5);
+    int const zooms[] = { 5, 6, 9, 20, 40 };
+    for(int zoom : zooms) {
+        check_render(w, live, 0, 0, zoom, 3, 3);
+        check_render(w, live, -1, -1, zoom, 3, 3);
+        check_render(w, live, -(std::int64_t(1) << zoom), -(std::int64_t(1) << zoom), zoom, 3, 3);
+    }
+    // The world is centred on the origin, which is always a corner of
+    // pixels, so it spreads over four of them.
+    float total = 0;
+    for(float p : render(w, -1, -1, 5, 2, 2)) total += p;
+    CHECK(total == static_cast<float>(std::ldexp(static_cast<double>(live.size()), -10)));
+}
+
+TEST_CASE(render_worlds_wider_than_coordinates) {
+    // Blocks in the corners of the coordinates and in the middle. Stepping
+    // grows the world past 2^64 sides, where only the central quadrant of
+    // the root's quadrants is ever visited.
+    std::int64_t const max = std::numeric_limits<std::int64_t>::max();
+    std::int64_t const min = std::numeric_limits<std::int64_t>::min();
+    test::cells live;
+    std::int64_t const corners[] = { min, max - 1, -1 };
+    for(std::int64_t x : corners)
+        for(std::int64_t y : corners)
+            live.insert({ { x, y }, { x + 1, y }, { x, y + 1 }, { x + 1, y + 1 } });
+    auto w = test::make_world(std::make_shared<hlife::cellspace>(), live);
+    w.advance(1);
+    CHECK(w.level > 64);
+    CHECK(w.population() == live.size());
+
+    // Viewports around each block, running past the largest coordinates
+    // where they can.
+    auto before = [min](std::int64_t c) { return c == min? c : c - 3; };
+    for(std::int64_t x : corners) {
+        for(std::int64_t y : corners) {
+            for(int zoom = 0; zoom <= 2; ++zoom) {
+                check_render(w, live, before(x), before(y), zoom, 6, 6);
+                check_render(w, live, x, y, zoom, 4, 4);
+            }
+        }
+    }
+    check_render(w, live, min, min, 62, 4, 4);
+    check_render(w, live, min, min, 63, 2, 2);
+    check_render(w, live, -5, -5, 40, 3, 3);
+}
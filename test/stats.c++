@@ -0,0 +1,61 @@
+// Yajna
+//
+// Written in 2015 by Martinho Fernandes <martinho.fernandes@gmail.com>
+//
+// To the extent possible under law, the author(s) have dedicated all copyright and related
+// and neighboring rights to this software to the public domain worldwide. This software is
+// distributed without any warranty.
+//
+// You should have received a copy of the CC0 Public Domain Dedication along with this software.
+// If not, see <http://creativecommons.org/publicdomain/zero/1.0/>
+
+// Tests of the statistics of cellspaces, in builds with HLIFE_STATS
+
+#include "test.h++"
+
+namespace {
+    std::uint64_t evaluations(hlife::cellspace_stats const& s) {
+        std::uint64_t n = 0;
+        for(auto const& l : s.levels) n += l.results + l.result_hits + l.steps + l.step_hits;
+        return n;
+    }
+}
+
+TEST_CASE(stats_are_kept_per_cellspace) {
+    std::mt19937 rng(19);
+    test::cells soup = test::soup(-16, -16, 32, 32, 0.35, rng);
+    auto busy = std::make_shared<hlife::cellspace>();
+    auto idle = std::make_shared<hlife::cellspace>();
+    auto w = test::make_world(busy, soup);
+    hlife::cellspace_stats before = idle->stats();
+    w.advance(100);
+    hlife::cellspace_stats after = idle->stats();
+    CHECK(after.nodes.lookups() == before.nodes.lookups());
+    CHECK(evaluations(after) == evaluations(before));
+    CHECK(after.cells == idle->size());
+
+    hlife::cellspace_stats s = busy->stats();
+    CHECK(s.cells == busy->size());
+    CHECK(s.memory_in_use == busy->memory_in_use());
+    if(!hlife::stats_enabled) return;
+    CHECK(evaluations(before) == 0);
+    CHECK(s.nodes.inserts + s.tiles.inserts == busy->size());
+    CHECK(evaluations(s) > 0);
+}
+
+TEST_CASE(stats_count_all_threads) {
+    if(!hlife::stats_enabled) return;
+    std::mt19937 rng(20);
+    test::cells soup = test::soup(-32, -32, 64, 64, 0.35, rng);
+    hlife::task_pool pool(4);
+    auto sequential = std::make_shared<hlife::cellspace>();
+    auto parallel = std::make_shared<hlife::cellspace>();
+    auto a = test::make_world(sequential, soup, 7);
+    auto b = test::make_world(parallel, soup, 7);
+    a.step();
+    b.step(pool, 4);
+    // Both create the same cells, however many threads race to look them up.
+    CHECK(sequential->stats().nodes.inserts + sequential->stats().tiles.inserts == sequential->size());
+    CHECK(parallel->stats().nodes.inserts + parallel->stats().tiles.inserts == parallel->size());
+    CHECK(parallel->size() == sequential->size());
+}
@@ -0,0 +1,171 @@
+// Yajna
+//
+// Written in 2015 by Martinho Fernandes <martinho.fernandes@gmail.com>
+//
+// To the extent possible under law, the author(s) have dedicated all copyright and related
+// and neighboring rights to this software to the public domain worldwide. This software is
+// distributed without any warranty.
+//
+// You should have received a copy of the CC0 Public Domain Dedication along with this software.
+// If not, see <http://creativecommons.org/publicdomain/zero/1.0/>
+
+// Test cases and a naive simulator to check the hashlife results against
+
+#ifndef HLIFE_TEST_HPP
+#define HLIFE_TEST_HPP
+
+// The standard headers come first so that only the members of hlife are
+// opened up below.
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <istream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <ostream>
+#include <random>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+// Tests reach into the cells of worlds to compare them cell by cell.
+#define private public
+#include <hlife/hlife.h++>
+#include <hlife/patterns.h++>
+#undef private
+
+namespace test {
+    // Thrown by a failed check.
+    struct failure : std::runtime_error {
+        explicit failure(std::string const& what) : std::runtime_error(what) {}
+    };
+
+    using test_function = void (*)();
+    inline std::vector<std::pair<char const*, test_function>>& registry() {
+        static std::vector<std::pair<char const*, test_function>> cases;
+        return cases;
+    }
+    struct registration {
+        registration(char const* name, test_function f) { registry().emplace_back(name, f); }
+    };
+
+    inline void check(bool ok, char const* what, char const* file, int line) {
+        if(!ok) throw failure(std::string(file) + ":" + std::to_string(line) + ": " + what);
+    }
+
+    // HighLife, B36/S23, and a rule that tells eight neighbours from none,
+    // B3/S238.
+    using highlife = hlife::rule<1u << 3 | 1u << 6, 1u << 2 | 1u << 3>;
+    using life_with_eight = hlife::rule<1u << 3, 1u << 2 | 1u << 3 | 1u << 8>;
+
+    // The live cells of an unbounded plane, as (x, y).
+    using cells = std::set<std::pair<std::int64_t, std::int64_t>>;
+
+    template <unsigned Birth, unsigned Survival>
+    cells naive_step(cells const& live, hlife::rule<Birth, Survival>) {
+        std::map<std::pair<std::int64_t, std::int64_t>, unsigned> counts;
+        for(auto const& c : live) {
+            counts[c];
+            for(int dy = -1; dy <= 1; ++dy)
+                for(int dx = -1; dx <= 1; ++dx)
+                    if(dx || dy) ++counts[std::make_pair(c.first + dx, c.second + dy)];
+        }
+        cells next;
+        for(auto const& n : counts) {
+            unsigned mask = live.count(n.first)? Survival : Birth;
+            if(mask >> n.second & 1) next.insert(n.first);
+        }
+        return next;
+    }
+    // Advances the plane cell by cell.
+    template <typename Rule>
+    cells naive_advance(cells live, std::uint64_t generations) {
+        for(; generations != 0; --generations) live = naive_step(live, Rule());
+        return live;
+    }
+
+    // A random soup of the given size, with its top-left corner at (x, y).
+    inline cells soup(std::int64_t x, std::int64_t y, int width, int height, double density, std::mt19937& rng) {
+        std::bernoulli_distribution alive(density);
+        cells live;
+        for(int j = 0; j < height; ++j)
+            for(int i = 0; i < width; ++i)
+                if(alive(rng)) live.emplace(x + i, y + j);
+        return live;
+    }
+
+    // A world holding the given cells.
+    template <typename Rule>
+    hlife::basic_world<Rule> make_world(std::shared_ptr<hlife::basic_cellspace<Rule>> space, cells const& live, int level = 4) {
+        hlife::basic_world<Rule> w(std::move(space), level);
+        std::vector<typename hlife::basic_world<Rule>::edit> edits;
+        for(auto const& c : live) edits.push_back({ c.first, c.second, true });
+        w.set_cells(edits);
+        return w;
+    }
+
+    // The live cells of a cell with sides 2^level whose top-left corner is
+    // at (x, y).
+    template <typename Rule>
+    void gather(hlife::basic_cellspace<Rule> const& space, hlife::cell_ref c, int level, std::int64_t x, std::int64_t y, cells& live) {
+        if(&c == &space.empty_cell(level)) return;
+        if(level == 3) {
+            for(int j = 0; j < 8; ++j)
+                for(int i = 0; i < 8; ++i)
+                    if(c.tile >> (63 - 8 * j - i) & 1) live.emplace(x + i, y + j);
+            return;
+        }
+        std::int64_t half = std::int64_t(1) << (level-1);
+        gather(space, *c.q.nw, level-1, x, y, live);
+        gather(space, *c.q.ne, level-1, x + half, y, live);
+        gather(space, *c.q.sw, level-1, x, y + half, live);
+        gather(space, *c.q.se, level-1, x + half, y + half, live);
+    }
+    // The live cells of a world, in its own coordinates.
+    template <typename Rule>
+    cells live_cells(hlife::basic_world<Rule> const& w) {
+        cells live;
+        std::int64_t corner = -(std::int64_t(1) << (w.level-1));
+        gather(*w.space, *w.root, w.level, corner, corner, live);
+        return live;
+    }
+    // The live cells of a world, relative to its top-left corner.
+    template <typename Rule>
+    cells live_cells_from_corner(hlife::basic_world<Rule> const& w) {
+        cells live;
+        gather(*w.space, *w.root, w.level, 0, 0, live);
+        return live;
+    }
+}
+
+#define TEST_CASE(name) \
+    static void name(); \
+    static ::test::registration name##_registration(#name, name); \
+    static void name()
+
+#define CHECK(...) ::test::check((__VA_ARGS__), #__VA_ARGS__, __FILE__, __LINE__)
+
+#define CHECK_THROWS(exception, ...) \
+    do { \
+        bool thrown = false; \
+        try { __VA_ARGS__; } catch(exception const&) { thrown = true; } \
+        ::test::check(thrown, #__VA_ARGS__ " throws " #exception, __FILE__, __LINE__); \
+    } while(false)
+
+#endif // HLIFE_TEST_HPP
@@ -0,0 +1,165 @@
+// Yajna
+//
+// Written in 2015 by Martinho Fernandes <martinho.fernandes@gmail.com>
+//
+// To the extent possible under law, the author(s) have dedicated all copyright and related
+// and neighboring rights to this software to the public domain worldwide. This software is
+// distributed without any warranty.
+//
+// You should have received a copy of the CC0 Public Domain Dedication along with this software.
+// If not, see <http://creativecommons.org/publicdomain/zero/1.0/>
+
+// Tests of worlds: editing, stepping and growing
+
+#include "test.h++"
+
+#include <limits>
+
+TEST_CASE(advance_grows_the_world) {
+    // A glider travels a quarter cell per generation, out of any fixed world.
+    test::cells glider { { 1, 0 }, { 2, 1 }, { 0, 2 }, { 1, 2 }, { 2, 2 } };
+    auto w = test::make_world(std::make_shared<hlife::cellspace>(), glider);
+    w.advance(4096);
+    test::cells expected;
+    for(auto const& c : glider) expected.emplace(c.first + 1024, c.second + 1024);
+    CHECK(test::live_cells(w) == expected);
+    CHECK(w.level > 11);
+}
+
+TEST_CASE(step_matches_naive) {
+    // Each step advances by half the sides of the world as it starts, and
+    // grows the world so that nothing is clipped.
+    std::mt19937 rng(8);
+    test::cells expected = test::soup(-15, -15, 30, 30, 0.4, rng);
+    auto w = test::make_world(std::make_shared<hlife::cellspace>(), expected, 5);
+    std::uint64_t generation = 0;
+    for(int i = 0; i < 3; ++i) {
+        std::uint64_t stride = std::uint64_t(1) << (w.level-1);
+        w.step();
+        expected = test::naive_advance<hlife::life>(expected, stride);
+        generation += stride;
+        CHECK(w.current_generation() == generation);
+        CHECK(test::live_cells(w) == expected);
+    }
+}
+
+TEST_CASE(set_cells_matches_reference) {
+    std::mt19937 rng(7);
+    auto w = hlife::world(std::make_shared<hlife::cellspace>(), 4);
+    test::cells expected;
+    std::uniform_int_distribution<std::int64_t> near(-100, 100);
+    std::uniform_int_distribution<int> coin(0, 3);
+    for(int round = 0; round < 8; ++round) {
+        std::vector<hlife::world::edit> edits;
+        for(int i = 0; i < 500; ++i) {
+            hlife::world::edit e { near(rng), near(rng), coin(rng) != 0 };
+            edits.push_back(e);
+        }
+        for(auto const& e : edits) {
+            if(e.alive) expected.emplace(e.x, e.y);
+            else expected.erase(std::make_pair(e.x, e.y));
+        }
+        w.set_cells(edits);
+        CHECK(test::live_cells(w) == expected);
+        CHECK(w.population() == expected.size());
+        for(auto const& e : edits) CHECK(w.get_cell(e.x, e.y) == (expected.count(std::make_pair(e.x, e.y)) != 0));
+    }
+}
+
+TEST_CASE(set_cell_at_extreme_coordinates) {
+    std::int64_t const min = std::numeric_limits<std::int64_t>::min();
+    std::int64_t const max = std::numeric_limits<std::int64_t>::max();
+    std::int64_t const far = std::int64_t(1) << 40;
+    auto w = hlife::world(std::make_shared<hlife::cellspace>(), 4);
+    std::pair<std::int64_t, std::int64_t> const points[] = {
+        { 0, 0 }, { -1, -1 }, { far, -far }, { -far, far + 3 },
+        { min, min }, { max, max }, { min, max }, { max, 0 }, { 0, min },
+    };
+    for(auto const& p : points) w.set_cell(p.first, p.second, true);
+    for(auto const& p : points) CHECK(w.get_cell(p.first, p.second));
+    CHECK(!w.get_cell(1, 0));
+    CHECK(!w.get_cell(far, far));
+    CHECK(!w.get_cell(min + 1, min));
+    CHECK(!w.get_cell(max - 1, max));
+    CHECK(w.population() == 9);
+
+    w.set_cell(min, min, false);
+    w.set_cell(far, -far, false);
+    CHECK(!w.get_cell(min, min));
+    CHECK(!w.get_cell(far, -far));
+    CHECK(w.get_cell(max, max));
+    CHECK(w.population() == 7);
+}
+
+TEST_CASE(get_cell_outside_the_world_is_dead) {
+    auto w = hlife::world(std::make_shared<hlife::cellspace>(), 4);
+    w.set_cell(-8, 7, true);
+    CHECK(w.level == 4);
+    CHECK(w.get_cell(-8, 7));
+    CHECK(!w.get_cell(-9, 7));
+    CHECK(!w.get_cell(-8, 8));
+    CHECK(!w.get_cell(1000, 1000));
+}
+
+TEST_CASE(batched_edits_match_single_edits) {
+    // Both build the same canonical root in a shared cellspace, including
+    // edits that kill cells and edits that repeat.
+    std::mt19937 rng(27);
+    std::uniform_int_distribution<std::int64_t> far(-5000, 5000);
+    std::vector<hlife::world::edit> edits;
+    for(int i = 0; i < 2000; ++i) {
+        hlife::world::edit e { far(rng) / (i % 3 + 1), far(rng) / (i % 5 + 1), i % 4 != 0 };
+        edits.push_back(e);
+    }
+    auto space = std::make_shared<hlife::cellspace>();
+    hlife::world batched(space, 4), single(space, 4);
+    batched.set_cells(edits);
+    for(auto const& e : edits) single.set_cell(e.x, e.y, e.alive);
+    CHECK(batched.level == single.level);
+    CHECK(batched.root == single.root);
+}
+
+TEST_CASE(later_edits_take_precedence) {
+    auto w = hlife::world(std::make_shared<hlife::cellspace>(), 4);
+    w.set_cells({ { 3, 3, true }, { -2, 5, true }, { 3, 3, false }, { 100, 0, true },
+                  { -2, 5, false }, { 3, 3, true }, { 100, 0, false } });
+    CHECK(w.get_cell(3, 3));
+    CHECK(!w.get_cell(-2, 5));
+    CHECK(!w.get_cell(100, 0));
+    CHECK(w.population() == 1);
+}
+
+TEST_CASE(growth_keeps_the_centre) {
+    // Cells keep their coordinates as edits far away grow the world.
+    test::cells expected { { 0, 0 }, { -1, -1 }, { 7, -8 }, { -8, 7 } };
+    auto w = test::make_world(std::make_shared<hlife::cellspace>(), expected);
+    CHECK(w.level == 4);
+    w.set_cell(1000, -1000, true);
+    expected.emplace(1000, -1000);
+    CHECK(w.level == 11);
+    CHECK(test::live_cells(w) == expected);
+    w.set_cell(-1025, 0, true);
+    expected.emplace(-1025, 0);
+    CHECK(w.level == 12);
+    CHECK(test::live_cells(w) == expected);
+}
+
+TEST_CASE(steps_grow_patterns_at_the_edge) {
+    // A blinker on the edge of the world is neither clipped nor shifted,
+    // whether the world is stepped sequentially or in parallel.
+    test::cells blinker { { 7, -8 }, { 7, -7 }, { 7, -6 } };
+    hlife::task_pool pool(2);
+    auto sequential = test::make_world(std::make_shared<hlife::cellspace>(), blinker);
+    auto parallel = test::make_world(std::make_shared<hlife::cellspace>(), blinker);
+    for(int i = 0; i < 3; ++i) {
+        std::uint64_t before = sequential.current_generation();
+        sequential.step();
+        parallel.step(pool, 4);
+        std::uint64_t stride = sequential.current_generation() - before;
+        CHECK(parallel.current_generation() == sequential.current_generation());
+        CHECK(sequential.level > 4);
+        CHECK(test::live_cells(sequential) == test::naive_advance<hlife::life>(blinker, sequential.current_generation()));
+        CHECK(test::live_cells(parallel) == test::live_cells(sequential));
+        CHECK(stride >= 8);
+    }
+}
@@ -34,6 +34,7 @@ parser.add_argument('--cxx', default=None, metavar='executable', help='compiler
 parser.add_argument('--msvc', action='store_true', help='use the MSVC++ toolchain')
 parser.add_argument('--boost-dir', default=None, metavar='path', help='path of boost folder (i.e. the folder with include/ and lib/ subfolders)')
 parser.add_argument('--no-lto', action='store_true', help='do not perform link-time optimisation')
+parser.add_argument('--stats', action='store_true', help='collect hash-consing and memoisation statistics')
 args = parser.parse_args()
 
 tools = msvc.Toolchain() if args.msvc else gcc.Toolchain()
@@ -51,7 +52,7 @@ cxx_flags = flags(tools.cxx_flags(),
                   tools.debug_flags() if args.debug else tools.optimisation_flags(),
                   [] if args.no_lto or args.debug else tools.linker_lto_flags())
 warning_flags = flags(tools.max_warnings())
-define_flags = ''
+define_flags = flags([tools.define('HLIFE_STATS')] if args.stats else [])
 lib_flags = ''
 ld_flags = flags(tools.link_flags(),
                  [] if args.no_lto or args.debug else tools.linker_lto_flags())
@@ -102,6 +103,19 @@ ninja.build(program, 'link',
 ninja.build('yajna', 'phony',
         inputs = program)
 
+# the same benchmarks, tracking the peak heap usage of the loaders
+heap_obj_files = [object_file(os.path.join('heap', fn)) for fn in src_files]
+for fn, obj in zip(src_files, heap_obj_files):
+    ninja.build(obj, 'cxx',
+            inputs = fn,
+            variables = { 'extraflags': tools.define('YAJNA_TRACK_HEAP') })
+
+heap_program = os.path.join('bin', 'yajna-heap') + tools.executable_extension()
+ninja.build(heap_program, 'link',
+        inputs = heap_obj_files)
+ninja.build('yajna-heap', 'phony',
+        inputs = heap_program)
+
 test_src_files = list(get_files('test', '*.c++'))
 test_obj_files = [object_file(fn) for fn in test_src_files]
 for fn in test_src_files: